@@ -36,6 +36,9 @@ typedef void (*ble_disconnection_cb_t)(struct k_work *item);
  *                            is established
  * @param[in] on_disconnect   function to call when Bluetooth LE connection
  *                            is ended
+ *
+ * The sent callback of @p nus_clbs is chained, it still runs for every
+ * notification once ble_utils has returned the TX credit.
  * @retval 0    On success.
  * @retval != 0 On failure.
  */
@@ -43,6 +46,14 @@ int ble_utils_init(struct bt_nus_cb *nus_clbs,
 				   ble_connection_cb_t on_connect,
 				   ble_disconnection_cb_t on_disconnect);
 
+/** @brief Queue a formatted message for the connected central.
+ *
+ * The message is formatted into a buffer shared by all callers, truncated to
+ * CONFIG_BLE_MSG_MAX_SIZE - 1 characters, then copied into the ring buffer.
+ * Thread context only, use bt_nus_printf_buffer from an ISR.
+ * @retval >0   Length of the queued message.
+ * @retval <0   -ENOTCONN without a connection, -ENOMEM if the ring is full.
+ */
 int bt_nus_printf(const char *fmt, ...);
 
 /** @brief ISR-safe version of bt_nus_printf that can be called from any context.
@@ -10,6 +10,7 @@
 #include <zephyr/bluetooth/uuid.h>
 #include <zephyr/logging/log.h>
 #include <zephyr/settings/settings.h>
+#include <zephyr/sys/atomic.h>
 #include <zephyr/sys/ring_buffer.h>
 
 #include "ble_utils.h"
@@ -33,20 +34,41 @@ LOG_MODULE_REGISTER(ble_utils, CONFIG_BLE_UTILS_LOG_LEVEL);
 #endif
 
 #ifndef CONFIG_BLE_THREAD_STACK_SIZE
-#define BLE_THREAD_STACK_SIZE 1024
+#define BLE_THREAD_STACK_SIZE 768
 #else
 #define BLE_THREAD_STACK_SIZE CONFIG_BLE_THREAD_STACK_SIZE
 #endif
 
+// Notifications in flight, one credit each. A credit is returned by the NUS sent
+// callback once the notification left the stack, so the controller queue stays full
+// without overrunning the TX buffers.
+#ifndef CONFIG_BT_CONN_TX_MAX
+#define BLE_TX_CREDITS 3
+#else
+#define BLE_TX_CREDITS CONFIG_BT_CONN_TX_MAX
+#endif
+
+// Wait before retrying a notification the stack had no buffer for
+#define BLE_TX_RETRY_DELAY K_MSEC(5)
+
 #ifndef CONFIG_BLE_THREAD_PRIORITY
 #define BLE_THREAD_PRIORITY 5
 #else
 #define BLE_THREAD_PRIORITY CONFIG_BLE_THREAD_PRIORITY
 #endif
 
-// Ring buffer for BLE messages
+// Ring buffer for BLE messages, each one a uint16_t length followed by the payload.
+// Any thread or ISR may queue, the BLE thread is the only reader. Every access to the
+// ring indices goes through ble_msg_lock, a message is reserved as a whole so callers
+// never interleave, and the reader sends straight from the ring memory.
 static uint8_t ble_msg_ring_buf_data[BLE_MSG_RING_BUF_SIZE];
 static struct ring_buf ble_msg_ring_buf;
+static struct k_spinlock ble_msg_lock;
+// Flush requested, done by the reader between two messages
+static atomic_t ble_msg_clear;
+// Formatting buffer of bt_nus_printf, shared by all callers
+static K_MUTEX_DEFINE(ble_msg_fmt_lock);
+static char ble_msg_fmt_buf[BLE_MSG_MAX_SIZE];
 
 // Thread for handling BLE messages
 static K_THREAD_STACK_DEFINE(ble_thread_stack, BLE_THREAD_STACK_SIZE);
@@ -56,6 +78,12 @@ static k_tid_t ble_thread_tid;
 // Semaphore to signal new messages in ring buffer
 static K_SEM_DEFINE(ble_msg_sem, 0, 1);
 
+// TX credits, see BLE_TX_CREDITS
+static K_SEM_DEFINE(ble_tx_credits, BLE_TX_CREDITS, BLE_TX_CREDITS);
+
+// Sent callback of the application, called after the credit is returned
+static void (*app_sent_cb)(struct bt_conn *conn);
+
 static void connected(struct bt_conn *conn, uint8_t err);
 static void disconnected(struct bt_conn *conn, uint8_t reason);
 static void auth_passkey_display(struct bt_conn *conn, unsigned int passkey);
@@ -94,6 +122,107 @@ static struct k_work on_disconnect_work;
 
 static struct bt_conn *current_conn;
 
+// All credits back, the semaphore limit keeps late sent callbacks from adding more
+static void ble_tx_credits_reset(void)
+{
+	for (int i = 0; i < BLE_TX_CREDITS; i++)
+	{
+		k_sem_give(&ble_tx_credits);
+	}
+}
+
+static void ble_nus_sent(struct bt_conn *conn)
+{
+	k_sem_give(&ble_tx_credits);
+
+	if (app_sent_cb)
+	{
+		app_sent_cb(conn);
+	}
+}
+
+/** @brief Send one chunk, waiting for a TX credit first.
+ *
+ * A full stack (-ENOMEM) is retried until the chunk goes out or the connection
+ * is lost, other errors are returned.
+ */
+static int ble_send_chunk(struct bt_conn *conn, const uint8_t *data, uint16_t len)
+{
+	while (current_conn == conn)
+	{
+		if (k_sem_take(&ble_tx_credits, K_MSEC(1000)) != 0)
+		{
+			// Credit lost or connection going down, check the connection again
+			continue;
+		}
+		if (current_conn != conn)
+		{
+			k_sem_give(&ble_tx_credits);
+			break;
+		}
+
+		int rc = bt_nus_send(conn, data, len);
+		if (rc == 0)
+		{
+			return 0;
+		}
+		// Not queued, no sent callback will return the credit
+		k_sem_give(&ble_tx_credits);
+		if (rc != -ENOMEM)
+		{
+			return rc;
+		}
+		k_sleep(BLE_TX_RETRY_DELAY);
+	}
+	return -ENOTCONN;
+}
+
+/** @brief Send the next message of the ring buffer, the length header already read.
+ *
+ * The payload is handed to the stack straight from the ring memory, one contiguous
+ * claim at a time (two around the end of the ring). It is always consumed, also when
+ * the connection is gone, so the reader stays on a message boundary.
+ */
+static int ble_send_message(struct bt_conn *conn, uint16_t len)
+{
+	int rc = conn ? 0 : -ENOTCONN;
+
+	while (len > 0)
+	{
+		uint8_t *data;
+
+		k_spinlock_key_t key = k_spin_lock(&ble_msg_lock);
+		uint32_t claimed = ring_buf_get_claim(&ble_msg_ring_buf, &data, len);
+		k_spin_unlock(&ble_msg_lock, key);
+
+		if (claimed == 0)
+		{
+			return -EIO;
+		}
+
+		// The claimed bytes are not free space, producers cannot touch them until finished
+		for (uint32_t offset = 0; rc == 0 && offset < claimed;)
+		{
+			uint16_t chunk_size = MIN(bt_nus_get_mtu(conn), claimed - offset);
+
+			if (chunk_size == 0)
+			{
+				rc = -ENOTCONN;
+				break;
+			}
+			rc = ble_send_chunk(conn, data + offset, chunk_size);
+			offset += chunk_size;
+		}
+
+		key = k_spin_lock(&ble_msg_lock);
+		ring_buf_get_finish(&ble_msg_ring_buf, claimed);
+		k_spin_unlock(&ble_msg_lock, key);
+
+		len -= claimed;
+	}
+	return rc;
+}
+
 static void connected(struct bt_conn *conn, uint8_t err)
 {
 	if (err)
@@ -104,6 +233,7 @@ static void connected(struct bt_conn *conn, uint8_t err)
 
 	LOG_INF("Connected");
 	current_conn = bt_conn_ref(conn);
+	ble_tx_credits_reset();
 
 	k_work_submit(&on_connect_work);
 }
@@ -119,6 +249,8 @@ static void disconnected(struct bt_conn *conn, uint8_t reason)
 
 		// Clear any pending messages in the ring buffer when disconnected
 		ble_utils_clear_ring_buffer();
+		// Wake the sending thread, notifications still queued are dropped with the link
+		ble_tx_credits_reset();
 
 		k_work_submit(&on_disconnect_work);
 	}
@@ -184,9 +316,6 @@ static void ble_thread_handler(void *arg1, void *arg2, void *arg3)
 	ARG_UNUSED(arg2);
 	ARG_UNUSED(arg3);
 
-	uint8_t message_buffer[BLE_MSG_MAX_SIZE];
-	uint16_t message_len;
-
 	LOG_INF("BLE message thread started");
 
 	while (1)
@@ -195,50 +324,35 @@ static void ble_thread_handler(void *arg1, void *arg2, void *arg3)
 		k_sem_take(&ble_msg_sem, K_FOREVER);
 
 		// Process all messages in the ring buffer
-		while (ring_buf_size_get(&ble_msg_ring_buf) > 0)
+		while (1)
 		{
-			struct bt_conn *conn = current_conn;
-			if (!conn)
-			{
-				// No connection, drain the ring buffer
-				ring_buf_reset(&ble_msg_ring_buf);
-				break;
-			}
+			uint16_t message_len;
 
-			// Get message length (first 2 bytes)
-			if (ring_buf_get(&ble_msg_ring_buf, (uint8_t *)&message_len, sizeof(message_len)) != sizeof(message_len))
+			k_spinlock_key_t key = k_spin_lock(&ble_msg_lock);
+			if (atomic_cas(&ble_msg_clear, 1, 0))
 			{
-				LOG_ERR("Failed to read message length from ring buffer");
-				break;
+				ring_buf_reset(&ble_msg_ring_buf);
 			}
+			uint32_t got = ring_buf_get(&ble_msg_ring_buf, (uint8_t *)&message_len, sizeof(message_len));
+			k_spin_unlock(&ble_msg_lock, key);
 
-			// Validate message length
-			if (message_len == 0 || message_len > BLE_MSG_MAX_SIZE)
+			if (got == 0)
 			{
-				LOG_ERR("Invalid message length: %d", message_len);
 				break;
 			}
-
-			// Get message data
-			if (ring_buf_get(&ble_msg_ring_buf, message_buffer, message_len) != message_len)
+			// Messages are queued whole, a partial header means the ring is corrupt
+			if (got != sizeof(message_len) || message_len == 0 || message_len > BLE_MSG_MAX_SIZE)
 			{
-				LOG_ERR("Failed to read message data from ring buffer");
-				break;
+				LOG_ERR("Invalid message in ring buffer, flushing");
+				atomic_set(&ble_msg_clear, 1);
+				continue;
 			}
 
-			// Send message in chunks
-			const int chunk_size = 253;
-			for (int offset = 0; offset < message_len; offset += chunk_size)
+			// No connection: the message is consumed all the same, which drains the ring
+			int rc = ble_send_message(current_conn, message_len);
+			if (rc < 0 && rc != -ENOTCONN)
 			{
-				int send_len = (message_len - offset > chunk_size) ? chunk_size : (message_len - offset);
-				int rc = bt_nus_send(conn, &message_buffer[offset], send_len);
-				if (rc < 0)
-				{
-					LOG_ERR("BLE NUS send failed: %d", rc);
-					break;
-				}
-				// Small delay between chunks to avoid overwhelming the BLE stack
-				k_sleep(K_MSEC(20));
+				LOG_ERR("BLE NUS send failed: %d", rc);
 			}
 		}
 	}
@@ -292,7 +406,13 @@ int ble_utils_init(struct bt_nus_cb *nus_clbs, ble_connection_cb_t on_connect,
 		settings_load();
 	}
 
-	ret = bt_nus_init(nus_clbs);
+	// Chain the sent callback, it returns the TX credits
+	static struct bt_nus_cb clbs;
+	clbs = *nus_clbs;
+	app_sent_cb = nus_clbs->sent;
+	clbs.sent = ble_nus_sent;
+
+	ret = bt_nus_init(&clbs);
 	if (ret)
 	{
 		LOG_ERR("Failed to initialize UART service (error: %d)", ret);
@@ -330,7 +450,9 @@ end:
 	return ret;
 }
 
-// Modified bt_nus_printf to use ring buffer and thread
+// Formats into one shared buffer, so callers need no message buffer on their stack.
+// The formatting runs under a mutex with interrupts enabled, only the copy into the
+// ring is done under ble_msg_lock, by bt_nus_printf_buffer.
 int bt_nus_printf(const char *fmt, ...)
 {
 	if (!current_conn)
@@ -338,27 +460,22 @@ int bt_nus_printf(const char *fmt, ...)
 		return -ENOTCONN;
 	}
 
-	char message_buffer[BLE_MSG_MAX_SIZE];
+	k_mutex_lock(&ble_msg_fmt_lock, K_FOREVER);
+
 	va_list args;
 	va_start(args, fmt);
-	int len = vsnprintk(message_buffer, sizeof(message_buffer), fmt, args);
+	int len = vsnprintk(ble_msg_fmt_buf, sizeof(ble_msg_fmt_buf), fmt, args);
 	va_end(args);
 
-	if (len < 0)
+	if (len >= 0)
 	{
-		return len;
+		// Truncated to the buffer, bt_nus_printf_buffer applies the same limit
+		len = bt_nus_printf_buffer(ble_msg_fmt_buf, MIN(len, sizeof(ble_msg_fmt_buf) - 1));
 	}
 
-	// Ensure null-termination
-	message_buffer[sizeof(message_buffer) - 1] = '\0';
-
-	// Adjust length if truncated
-	if (len >= sizeof(message_buffer))
-	{
-		len = sizeof(message_buffer) - 1;
-	}
+	k_mutex_unlock(&ble_msg_fmt_lock);
 
-	return bt_nus_printf_buffer(message_buffer, len);
+	return len;
 }
 
 // ISR-safe version that can be called from any context
@@ -380,37 +497,25 @@ int bt_nus_printf_buffer(const char *buffer, size_t len)
 		len = BLE_MSG_MAX_SIZE - 1;
 	}
 
-	// Check if we're in ISR context
-	bool in_isr = k_is_in_isr();
-
-	// Check if ring buffer has enough space (message length + 2 bytes for length header)
-	uint32_t space_needed = len + sizeof(uint16_t);
-	if (ring_buf_space_get(&ble_msg_ring_buf) < space_needed)
-	{
-		if (!in_isr)
-		{
-			LOG_WRN("Ring buffer full, dropping message");
-		}
-		return -ENOMEM;
-	}
-
-	// Add message length header to ring buffer
+	// Whole message reserved under the lock: the header and the payload are contiguous
+	// in the ring whatever the other producers do, and either both go in or none
 	uint16_t msg_len = (uint16_t)len;
-	if (ring_buf_put(&ble_msg_ring_buf, (uint8_t *)&msg_len, sizeof(msg_len)) != sizeof(msg_len))
+	bool queued = false;
+
+	k_spinlock_key_t key = k_spin_lock(&ble_msg_lock);
+	if (ring_buf_space_get(&ble_msg_ring_buf) >= len + sizeof(msg_len))
 	{
-		if (!in_isr)
-		{
-			LOG_ERR("Failed to add message length to ring buffer");
-		}
-		return -ENOMEM;
+		ring_buf_put(&ble_msg_ring_buf, (uint8_t *)&msg_len, sizeof(msg_len));
+		ring_buf_put(&ble_msg_ring_buf, (uint8_t *)buffer, len);
+		queued = true;
 	}
+	k_spin_unlock(&ble_msg_lock, key);
 
-	// Add message data to ring buffer
-	if (ring_buf_put(&ble_msg_ring_buf, (uint8_t *)buffer, len) != len)
+	if (!queued)
 	{
-		if (!in_isr)
+		if (!k_is_in_isr())
 		{
-			LOG_ERR("Failed to add message data to ring buffer");
+			LOG_WRN("Ring buffer full, dropping message");
 		}
 		return -ENOMEM;
 	}
@@ -437,14 +542,19 @@ int bt_nus_printf_safe(const char *msg)
 // Get ring buffer statistics for debugging
 void ble_utils_get_ring_buffer_stats(uint32_t *used_bytes, uint32_t *free_bytes, uint32_t *total_bytes)
 {
+	k_spinlock_key_t key = k_spin_lock(&ble_msg_lock);
+	uint32_t used = ring_buf_size_get(&ble_msg_ring_buf);
+	uint32_t space = ring_buf_space_get(&ble_msg_ring_buf);
+	k_spin_unlock(&ble_msg_lock, key);
+
 	if (used_bytes)
 	{
-		*used_bytes = ring_buf_size_get(&ble_msg_ring_buf);
+		*used_bytes = used;
 	}
 
 	if (free_bytes)
 	{
-		*free_bytes = ring_buf_space_get(&ble_msg_ring_buf);
+		*free_bytes = space;
 	}
 
 	if (total_bytes)
@@ -454,8 +564,10 @@ void ble_utils_get_ring_buffer_stats(uint32_t *used_bytes, uint32_t *free_bytes,
 }
 
 // Clear the ring buffer (flush all pending messages)
+// The BLE thread may be sending from the ring, it does the reset between two messages
 void ble_utils_clear_ring_buffer(void)
 {
-	ring_buf_reset(&ble_msg_ring_buf);
-	LOG_INF("Ring buffer cleared");
+	atomic_set(&ble_msg_clear, 1);
+	k_sem_give(&ble_msg_sem);
+	LOG_INF("Ring buffer clear requested");
 }
\ No newline at end of file
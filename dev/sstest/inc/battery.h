@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stdint.h>
+
+// Power policy levels, with hysteresis between them
+enum
+{
+    BATTERY_LEVEL_NORMAL,
+    BATTERY_LEVEL_LOW,      // Below BATTERY_LOW_SOC, reduce sample rate and TX power
+    BATTERY_LEVEL_CRITICAL, // Below BATTERY_CRITICAL_SOC, keep only the essentials
+};
+
+typedef struct
+{
+    double voltage;          // Filtered supply voltage as measured, V
+    double ocv;              // Load compensated (open circuit) voltage, V
+    float soc;               // State of charge, 0..100 %
+    uint32_t runtime_min;    // Remaining runtime at the current load
+    uint32_t load_ua;        // Average current the estimate is based on
+    uint8_t level;           // BATTERY_LEVEL_*
+} battery_state_t;
+
+// Estimate from the ADC supply voltage, call about every BATTERY_UPDATE_PERIOD_MS
+#define BATTERY_UPDATE_PERIOD_MS 10000
+
+extern int battery_update(void);
+extern void battery_get(battery_state_t *state);
+extern void battery_set_load(uint32_t load_ua);
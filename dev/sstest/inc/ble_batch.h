@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Batching between the acquisition and the radio: frames are appended to a buffer
+// sized to the ATT payload of the connection (or the SDU of the L2CAP channel, see
+// ble_l2cap.h) and sent as one notification once it is full, or BLE_BATCH_DEADLINE_MS
+// after the first frame went in, whichever comes first. A frame never spans two
+// notifications.
+#define BLE_BATCH_DEADLINE_MS 100
+
+typedef struct
+{
+    uint32_t notifications;    // Batches sent
+    uint32_t frames;           // Frames sent in them
+    uint32_t bytes;            // Payload bytes sent
+    uint32_t capacity;         // Payload the same notifications could have carried
+    uint32_t deadline_flushes; // Notifications sent by the deadline, not full
+    uint32_t dropped;          // Frames lost to a missing connection or full TX buffers
+} ble_batch_stats_t;
+
+extern uint16_t ble_batch_capacity(void);
+extern int ble_batch_add(const void *frame, uint16_t len);
+extern void ble_batch_flush(void);
+extern void ble_batch_stats(ble_batch_stats_t *stats, bool reset);
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <stdint.h>
+#include <zephyr/kernel.h>
+
+// LE credit based L2CAP channel for the sensor stream. The central opens it on
+// BLE_L2CAP_PSM once connected, from then on the batched telemetry goes through it
+// in SDUs of up to BLE_L2CAP_SDU_MAX bytes. NUS stays the control path and carries
+// the stream again once the channel is closed.
+#define BLE_L2CAP_PSM 0x0081 // Dynamic LE PSM, fixed so the central needs no discovery
+#define BLE_L2CAP_SDU_MAX 1024
+// Longest a producer thread waits for a TX buffer, the system workqueue never waits
+#define BLE_L2CAP_TX_TIMEOUT K_MSEC(100)
+
+extern int ble_l2cap_init(void);
+extern int ble_l2cap_send(const void *data, uint16_t len, k_timeout_t timeout);
+extern uint16_t ble_l2cap_sdu_size(void);
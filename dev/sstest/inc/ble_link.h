@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdint.h>
+
+// Link profiles, requested by the peripheral after the connection and on every change
+enum
+{
+    BLE_LINK_PROFILE_STREAMING, // 2M PHY, long data PDUs, 7.5-15 ms interval
+    BLE_LINK_PROFILE_IDLE,      // 1M PHY, short PDUs, 100-200 ms interval with latency
+};
+
+// Values in effect on the current connection, as reported by the stack
+typedef struct
+{
+    uint8_t profile;     // BLE_LINK_PROFILE_* last requested
+    uint16_t mtu;        // ATT MTU
+    uint16_t tx_octets;  // LL data PDU payload, 27..251
+    uint16_t rx_octets;
+    uint8_t tx_phy;      // BT_GAP_LE_PHY_*
+    uint8_t rx_phy;
+    uint16_t interval;   // Connection interval in 1.25 ms units
+    uint16_t latency;    // Peripheral latency in connection events
+    uint16_t timeout;    // Supervision timeout in 10 ms units
+} ble_link_info_t;
+
+// Called from the system workqueue once a negotiation round completed
+typedef void (*ble_link_report_cb_t)(const ble_link_info_t *info);
+
+extern void ble_link_set_profile(uint8_t profile);
+extern void ble_link_set_report_cb(ble_link_report_cb_t cb);
+extern int ble_link_get(ble_link_info_t *info);
@@ -1,3 +1,12 @@
 #pragma once
 
-extern int bt_nus_printf(const char *fmt, ...);
\ No newline at end of file
+#include <stdint.h>
+
+// Called from the Bluetooth RX thread for every NUS write from the central
+typedef void (*ble_rx_handler_t)(const uint8_t *data, uint16_t len);
+
+extern int bt_nus_printf(const char *fmt, ...);
+extern int ble_send(const void *data, uint16_t len);
+extern uint16_t ble_payload_size(void);
+extern void ble_set_rx_handler(ble_rx_handler_t handler);
+extern void ble_set_tx_power(int8_t dbm);
@@ -1,13 +1,163 @@
 #pragma once
 
+// FIFO geometry. Packet 1/2: header, accel or gyro 6, temp 1. Packet 3: header, accel 6,
+// gyro 6, temp 1, timestamp 2. Packet 4 (high resolution): header, accel 6, gyro 6,
+// temp 2, timestamp 2, the low nibbles of the 20-bit accel and gyro values 3.
+#define IIM42652_FIFO_SIZE 2048
+#define IIM42652_FIFO_PACKET_SIZE_SINGLE 8
+#define IIM42652_FIFO_PACKET_SIZE 16
+#define IIM42652_FIFO_PACKET_SIZE_HIRES 20
+#define IIM42652_FIFO_MAX_PACKETS (IIM42652_FIFO_SIZE / IIM42652_FIFO_PACKET_SIZE)
+#define IIM42652_FIFO_SOA_CAPACITY IIM42652_FIFO_MAX_PACKETS
+
+// Packet 4 data does not depend on FS_SEL: +-16 g and +-2000 dps at these sensitivities
+#define IIM42652_HIRES_ACC_LSB_PER_G 8192.0f
+#define IIM42652_HIRES_GYRO_LSB_PER_DPS 131.0f
+
+#include <stddef.h>
+#include <stdint.h>
+#include <zephyr/kernel.h>
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/drivers/spi.h>
+#include <zephyr/sys/util.h>
+
 typedef struct
 {
-    double acc[3];  // Accelerometer data in g
-    double gyro[3]; // Gyroscope data in dps
-    double temp;    // Temperature in Celsius
+    float acc[3];  // Accelerometer data in g
+    float gyro[3]; // Gyroscope data in dps
+    float temp;    // Temperature in Celsius
 } iim42652_data_t;
 
+// Raw sample as delivered by the sensor, scale with IIM42652_acc_scale/IIM42652_gyro_scale
+typedef struct
+{
+    int16_t acc[3];  // Raw accelerometer data
+    int16_t gyro[3]; // Raw gyroscope data
+    int16_t temp;    // Raw temperature, (temp / 132.48) + 25 in Celsius
+} iim42652_raw_t;
+
+// Q15 sample, +-1.0 is the configured full-scale range
+typedef struct
+{
+    int16_t acc[3];
+    int16_t gyro[3];
+    int16_t temp; // Offset from 25 C in 1/128 C
+} iim42652_q15_t;
+
+typedef struct
+{
+    uint64_t timestamp; // Uptime in ns, reconstructed from the sensor time base
+    iim42652_raw_t raw;
+} iim42652_fifo_sample_t;
+
+// Structure-of-arrays FIFO batch from IIM42652_fifo_unpack, one array per axis so
+// batches feed straight into vector filters and FFTs. acc/gyro hold the packet values
+// as delivered (16 or 20 bits), scale them with acc_scale/gyro_scale of the batch.
+typedef struct
+{
+    size_t count;
+    float acc_scale;  // g per LSB of acc
+    float gyro_scale; // dps per LSB of gyro
+    int32_t acc[3][IIM42652_FIFO_SOA_CAPACITY];
+    int32_t gyro[3][IIM42652_FIFO_SOA_CAPACITY];
+    int16_t temp[IIM42652_FIFO_SOA_CAPACITY];       // TEMP_DATA units, 132.48 LSB/C
+    uint64_t timestamp[IIM42652_FIFO_SOA_CAPACITY]; // Uptime in ns
+} iim42652_fifo_batch_t;
+
+// Offsets applied in silicon through OFFSET_USER0..8, added to every sample
+typedef struct
+{
+    int16_t gyro[3]; // 1/32 dps per LSB, +-2048 (+-64 dps)
+    int16_t acc[3];  // 0.5 mg per LSB, +-2048 (+-1 g)
+} iim42652_offsets_t;
+
+// Self-test outcome per axis, response is the output change with self-test enabled
+// relative to the factory trimmed response (1.0 for a nominal part)
+typedef struct
+{
+    uint8_t passed; // IIM42652_ST_* bits of the axes within limits
+    float gyro_response[3];
+    float acc_response[3];
+} iim42652_self_test_t;
+
+#define IIM42652_TEMP_SCALE (1.0f / 132.48f)
+#define IIM42652_TEMP_OFFSET 25.0f
+
+typedef void (*iim42652_event_handler_t)(void);
+
+#define IIM42652_SPI_OPERATION (SPI_OP_MODE_MASTER | SPI_WORD_SET(8) | SPI_TRANSFER_MSB)
+
+// Bus and INT1 line of a devicetree instance, defaults to the first invensense,iim42652 node
+extern int IIM42652_attach(const struct spi_dt_spec *spi, const struct gpio_dt_spec *int_gpio);
+extern void IIM42652_init(void);
+extern bool IIM42652_is_initialized(void);
 extern int IIM42652_data(iim42652_data_t *iim_data);
+extern int IIM42652_data_raw(iim42652_raw_t *raw);
+extern void IIM42652_convert(const iim42652_raw_t *raw, iim42652_data_t *iim_data, size_t count);
+extern void IIM42652_convert_q15(const iim42652_raw_t *raw, iim42652_q15_t *q15, size_t count);
+
+// Bank-aware register access. Configuration registers are shadowed in RAM: cached reads
+// cost no SPI, unchanged writes and redundant bank switches are skipped.
+extern int IIM42652_reg_read(uint8_t bank, uint8_t reg, uint8_t *value);
+extern int IIM42652_reg_read_burst(uint8_t bank, uint8_t reg, uint8_t *data, size_t len);
+extern int IIM42652_reg_write(uint8_t bank, uint8_t reg, uint8_t value);
+extern int IIM42652_reg_write_burst(uint8_t bank, uint8_t reg, const uint8_t *values, size_t len);
+extern int IIM42652_reg_update(uint8_t bank, uint8_t reg, uint8_t mask, uint8_t value);
+extern void IIM42652_reg_cache_invalidate(void);
+
+// SPI clock, clamped to 24 MHz and the bus spi-max-frequency
+extern int IIM42652_set_frequency(uint32_t frequency);
+extern uint32_t IIM42652_get_frequency(void);
+
+// Runtime configuration, see IIM42652_ODR_*, IIM42652_RANGE_* and IIM42652_UI_FILT_BW_*
+extern int IIM42652_configure(uint8_t odr, uint8_t acc_range, uint8_t gyro_range, uint8_t filters);
+extern void IIM42652_get_config(uint8_t *odr, uint8_t *acc_range, uint8_t *gyro_range);
+extern float IIM42652_odr_hz(uint8_t odr);
+extern float IIM42652_acc_scale(void);  // g per LSB
+extern float IIM42652_gyro_scale(void); // dps per LSB
+
+// FIFO burst acquisition
+extern int IIM42652_fifo_enable(uint16_t watermark);
+extern int IIM42652_fifo_disable(void);
+extern int IIM42652_fifo_flush(void);
+extern int IIM42652_fifo_recover(void);
+extern int IIM42652_fifo_count(uint16_t *count);
+extern int IIM42652_fifo_read(iim42652_fifo_sample_t *samples, size_t max_samples);
+extern int IIM42652_fifo_read_async(uint8_t *buffer, size_t max_packets, struct k_poll_signal *signal);
+extern int IIM42652_fifo_read_cb(uint8_t *buffer, size_t packets, spi_callback_t cb, void *user_data);
+extern int IIM42652_fifo_parse(const uint8_t *buffer, size_t packets, iim42652_fifo_sample_t *samples);
+extern int IIM42652_fifo_unpack(const uint8_t *buffer, size_t packets, iim42652_fifo_batch_t *batch);
+extern size_t IIM42652_fifo_packet_decode(const uint8_t *pkt, int32_t acc[3], int32_t gyro[3], int16_t *temp,
+                                          uint16_t *timestamp);
+extern int IIM42652_fifo_set_hires(bool enable);
+extern size_t IIM42652_fifo_packet_size(void);
+extern int IIM42652_fifo_lost_packets(uint16_t *lost);
+
+// Sensor time base (20-bit TMST counter, 1 us) correlated to k_uptime_ticks
+extern int IIM42652_timestamp_sync(void);
+extern uint64_t IIM42652_timestamp_to_uptime(uint64_t sensor_us);
+extern int32_t IIM42652_timestamp_drift(void); // Sensor clock error in ppb
+
+// INT1 event path, events are IIM42652_INT_* bits
+extern int IIM42652_int_enable(uint8_t events);
+extern int IIM42652_int_disable(void);
+extern int IIM42652_wait_event(k_timeout_t timeout, uint8_t *status);
+extern bool IIM42652_event_pending(void);
+
+// Wake-on-motion / significant motion, mode is one of IIM42652_SMD_MODE_*
+extern int IIM42652_wom_enable(uint16_t threshold_mg, uint8_t mode);
+extern int IIM42652_wom_disable(void);
+extern bool IIM42652_wom_active(void);
+extern int IIM42652_int_status(uint8_t *status);
+
+// Self-test and bias calibration. Both run on a stationary part, take about a second and
+// leave the FIFO and interrupts off; re-enable them afterwards. Offsets are kept over
+// re-initialization and, with CONFIG_IIM42652_CALIB_SETTINGS, over reboots.
+extern int IIM42652_self_test(iim42652_self_test_t *result);
+extern int IIM42652_calibrate(iim42652_offsets_t *offsets);
+extern int IIM42652_set_offsets(const iim42652_offsets_t *offsets);
+extern void IIM42652_get_offsets(iim42652_offsets_t *offsets);
+extern void IIM42652_set_event_handler(iim42652_event_handler_t handler);
 
 #define IIM42652_DEVICE_CONFIG UINT8_C(0x11)
 #define IIM42652_DRIVE_CONFIG UINT8_C(0x13)
@@ -139,6 +289,9 @@ extern int IIM42652_data(iim42652_data_t *iim_data);
 #define IIM42652_REG_BANK_2 UINT8_C(0x02)
 #define IIM42652_REG_BANK_3 UINT8_C(0x03)
 #define IIM42652_REG_BANK_4 UINT8_C(0x04)
+#define IIM42652_BANKS 5
+#define IIM42652_BANK_REGS 128
+#define IIM42652_BANK_UNKNOWN UINT8_C(0xFF)
 // ODR
 #define IIM42652_ODR_32KHZ UINT8_C(0x01)
 #define IIM42652_ODR_16KHZ UINT8_C(0x02)
@@ -172,7 +325,127 @@ extern int IIM42652_data(iim42652_data_t *iim_data);
 #define IIM42652_RANGE_PM31_25dps UINT8_C(0x06)
 #define IIM42652_RANGE_PM15_625dps UINT8_C(0x07)
 
+#define IIM42652_FS_SEL_SHIFT 5
+
+// UI filter bandwidth (GYRO_ACCEL_CONFIG0), low latency modes at 14 and 15
+#define IIM42652_UI_FILT_BW_ODR_DIV2 UINT8_C(0x00)
+#define IIM42652_UI_FILT_BW_ODR_DIV4 UINT8_C(0x01)
+#define IIM42652_UI_FILT_BW_ODR_DIV5 UINT8_C(0x02)
+#define IIM42652_UI_FILT_BW_ODR_DIV8 UINT8_C(0x03)
+#define IIM42652_UI_FILT_BW_ODR_DIV10 UINT8_C(0x04)
+#define IIM42652_UI_FILT_BW_ODR_DIV16 UINT8_C(0x05)
+#define IIM42652_UI_FILT_BW_ODR_DIV20 UINT8_C(0x06)
+#define IIM42652_UI_FILT_BW_ODR_DIV40 UINT8_C(0x07)
+#define IIM42652_UI_FILT_BW_LL_ODR UINT8_C(0x0E)
+#define IIM42652_UI_FILT_BW_LL_MAX UINT8_C(0x0F)
+
 // fifo mode
 #define IIM42652_FIFO_BYPASS UINT8_C(0x00)
 #define IIM42652_STREAM_TO_FIFO UINT8_C(0x01)
-#define IIM42652_STREAM_TO_FIFO_STOP_ON_FULL UINT8_C(0x10)
\ No newline at end of file
+#define IIM42652_STREAM_TO_FIFO_STOP_ON_FULL UINT8_C(0x02)
+#define IIM42652_FIFO_MODE_SHIFT 6
+
+// FIFO_CONFIG1 bits
+#define IIM42652_FIFO_RESUME_PARTIAL_RD BIT(6)
+#define IIM42652_FIFO_WM_GT_TH BIT(5)
+#define IIM42652_FIFO_HIRES_EN BIT(4)
+#define IIM42652_FIFO_TMST_FSYNC_EN BIT(3)
+#define IIM42652_FIFO_TEMP_EN BIT(2)
+#define IIM42652_FIFO_GYRO_EN BIT(1)
+#define IIM42652_FIFO_ACCEL_EN BIT(0)
+
+// INTF_CONFIG0 bits
+#define IIM42652_FIFO_HOLD_LAST_DATA_EN BIT(7)
+#define IIM42652_FIFO_COUNT_REC BIT(6)
+#define IIM42652_FIFO_COUNT_ENDIAN BIT(5)
+#define IIM42652_SENSOR_DATA_ENDIAN BIT(4)
+
+// SIGNAL_PATH_RESET bits
+#define IIM42652_TMST_STROBE BIT(2)
+#define IIM42652_FIFO_FLUSH BIT(1)
+
+// TMST_CONFIG bits
+#define IIM42652_TMST_TO_REGS_EN BIT(4)
+#define IIM42652_TMST_RES_16US BIT(3)
+#define IIM42652_TMST_DELTA_EN BIT(2)
+#define IIM42652_TMST_FSYNC_EN BIT(1)
+#define IIM42652_TMST_EN BIT(0)
+
+// TMSTVAL is a 20-bit counter, the FIFO packets carry its 16 LSBs
+#define IIM42652_TMST_MASK 0xFFFFFU
+#define IIM42652_FIFO_TMST_MASK 0xFFFFU
+// The FIFO timestamps are unwrapped by difference, which needs samples less than one
+// wrap of the 16-bit, 1 us field apart: 25 Hz (40 ms) is the slowest rate with FIFO on
+#define IIM42652_FIFO_TMST_RANGE_US (IIM42652_FIFO_TMST_MASK + 1U)
+#define IIM42652_FIFO_ODR_MIN_HZ 25
+
+// INT_CONFIG bits
+#define IIM42652_INT1_MODE_LATCHED BIT(2)
+#define IIM42652_INT1_DRIVE_PUSH_PULL BIT(1)
+#define IIM42652_INT1_POLARITY_HIGH BIT(0)
+
+// INT_CONFIG1 bits
+#define IIM42652_INT_TPULSE_DURATION BIT(6)
+#define IIM42652_INT_TDEASSERT_DISABLE BIT(5)
+#define IIM42652_INT_ASYNC_RESET BIT(4)
+
+// INT_SOURCE0 / INT_STATUS bits
+#define IIM42652_INT_DATA_READY BIT(3)
+#define IIM42652_INT_FIFO_THS BIT(2)
+#define IIM42652_INT_FIFO_FULL BIT(1)
+
+// INT_SOURCE1 / INT_STATUS2 bits
+#define IIM42652_INT_SMD BIT(3)
+#define IIM42652_INT_WOM_Z BIT(2)
+#define IIM42652_INT_WOM_Y BIT(1)
+#define IIM42652_INT_WOM_X BIT(0)
+#define IIM42652_INT_WOM (IIM42652_INT_WOM_X | IIM42652_INT_WOM_Y | IIM42652_INT_WOM_Z)
+
+// PWR_MGMT0 fields
+#define IIM42652_GYRO_MODE_LN (UINT8_C(0x03) << 2)
+#define IIM42652_ACCEL_MODE_LP UINT8_C(0x02)
+#define IIM42652_ACCEL_MODE_LN UINT8_C(0x03)
+
+// INTF_CONFIG1 bits
+#define IIM42652_ACCEL_LP_CLK_SEL BIT(3) // Set: RC oscillator, clear: wake-up oscillator
+
+// APEX_CONFIG0 fields
+#define IIM42652_DMP_POWER_SAVE BIT(7)
+#define IIM42652_DMP_ODR_25HZ UINT8_C(0x00)
+#define IIM42652_DMP_ODR_50HZ UINT8_C(0x02)
+
+// SMD_CONFIG fields
+#define IIM42652_WOM_INT_MODE_AND BIT(3) // Set: all axes must exceed the threshold
+#define IIM42652_WOM_MODE_PREV BIT(2)    // Set: compare with the previous sample
+#define IIM42652_SMD_MODE_DISABLED UINT8_C(0x00)
+#define IIM42652_SMD_MODE_WOM UINT8_C(0x01)
+#define IIM42652_SMD_MODE_SHORT UINT8_C(0x02) // Two WoM events 1 s apart
+#define IIM42652_SMD_MODE_LONG UINT8_C(0x03)  // Two WoM events 3 s apart
+
+// SELF_TEST_CONFIG bits, also used for iim42652_self_test_t.passed
+#define IIM42652_ACCEL_ST_POWER BIT(6)
+#define IIM42652_ST_ACCEL_Z BIT(5)
+#define IIM42652_ST_ACCEL_Y BIT(4)
+#define IIM42652_ST_ACCEL_X BIT(3)
+#define IIM42652_ST_GYRO_Z BIT(2)
+#define IIM42652_ST_GYRO_Y BIT(1)
+#define IIM42652_ST_GYRO_X BIT(0)
+#define IIM42652_ST_ACCEL (IIM42652_ST_ACCEL_X | IIM42652_ST_ACCEL_Y | IIM42652_ST_ACCEL_Z)
+#define IIM42652_ST_GYRO (IIM42652_ST_GYRO_X | IIM42652_ST_GYRO_Y | IIM42652_ST_GYRO_Z)
+
+// OFFSET_USER resolution, 12-bit signed fields
+#define IIM42652_OFFSET_GYRO_LSB_PER_DPS 32.0f
+#define IIM42652_OFFSET_ACC_LSB_PER_G 2000.0f
+#define IIM42652_OFFSET_MAX 2047
+
+// ACCEL_WOM_*_THR resolution, 1 g / 256
+#define IIM42652_WOM_THR_UG_PER_LSB 3906U
+
+// FIFO packet header bits
+#define IIM42652_FIFO_HEADER_MSG BIT(7)
+#define IIM42652_FIFO_HEADER_ACCEL BIT(6)
+#define IIM42652_FIFO_HEADER_GYRO BIT(5)
+#define IIM42652_FIFO_HEADER_20 BIT(4)
+#define IIM42652_FIFO_HEADER_TMST (BIT(3) | BIT(2))
+#define IIM42652_FIFO_HEADER_ODR_ACCEL BIT(1)
+#define IIM42652_FIFO_HEADER_ODR_GYRO BIT(0)
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <zephyr/drivers/sensor.h>
+#include "iim42652.h"
+
+// Buffer layout produced by the iim42652 sensor device for sensor_read() and
+// sensor_stream(). The decoder only relies on this header, so buffers can be
+// decoded long after the configuration changed.
+struct iim42652_encoded_header
+{
+    uint64_t timestamp;    // Uptime in ns of the read, for FIFO data of the newest packet
+    uint8_t acc_range;     // IIM42652_RANGE_PM*G at the time of the read
+    uint8_t gyro_range;    // IIM42652_RANGE_PM*dps at the time of the read
+    uint8_t odr;           // IIM42652_ODR_*
+    uint8_t events;        // INT_STATUS, IIM42652_INT_* bits
+    uint16_t fifo_packets; // Raw FIFO packets following the header, 0 for a one-shot read
+    uint8_t packet_size;   // IIM42652_FIFO_PACKET_SIZE or IIM42652_FIFO_PACKET_SIZE_HIRES
+    uint8_t reserved;
+};
+
+struct iim42652_encoded_data
+{
+    struct iim42652_encoded_header header;
+    // One-shot read: an iim42652_raw_t, FIFO read: fifo_packets packets straight from SPI DMA
+    uint8_t payload[];
+};
+
+extern int iim42652_get_decoder(const struct device *dev, const struct sensor_decoder_api **decoder);
+
+#ifdef CONFIG_IIM42652_EMUL
+#include <zephyr/drivers/emul.h>
+
+// Emulator backdoor, used in place of the real part on native_sim
+extern void iim42652_emul_set_reading(const struct emul *target, const iim42652_raw_t *raw);
+extern int iim42652_emul_push_fifo(const struct emul *target, const iim42652_raw_t *raw, uint16_t timestamp);
+extern void iim42652_emul_motion(const struct emul *target, uint8_t events);
+extern uint8_t iim42652_emul_get_reg(const struct emul *target, uint8_t bank, uint8_t reg);
+#endif
@@ -1,3 +1,38 @@
 #pragma once
 
-void sensor_task(void);
+#include <stdint.h>
+#include <zephyr/zbus/zbus.h>
+#include "battery.h"
+#include "iim42652.h"
+
+// Sensor results are published on zbus channels. Each sensor runs on its own schedule:
+// the IMU thread drains the FIFO at the watermark rate, the sensor scheduler thread
+// reads the temperature on STTS2004 events or its period and the battery every
+// BATTERY_UPDATE_PERIOD_MS. Publishers never wait, a slow consumer only misses updates.
+
+struct sensor_temp_msg
+{
+    int64_t uptime_ms;
+    int status; // 0 or the negative errno of the failed read
+    double temperature;
+    uint8_t alarms; // STTS2004_ALARM_*
+};
+
+struct sensor_battery_msg
+{
+    int64_t uptime_ms;
+    battery_state_t state;
+};
+
+// Newest sample of a FIFO batch (or of a poll), the batch itself stays with the IMU thread
+struct sensor_imu_msg
+{
+    uint64_t timestamp; // Uptime in ns of the sample
+    int status;         // 0 or the negative errno of the failed read
+    uint16_t samples;   // Samples in the batch
+    iim42652_data_t data;
+};
+
+ZBUS_CHAN_DECLARE(sensor_temp_chan, sensor_battery_chan, sensor_imu_chan);
+
+extern void sensor_init(void);
@@ -1,3 +1,27 @@
 #pragma once
 
+#include <stdint.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/util.h>
+
+// Resolution register values, each step doubles the conversion time
+#define STTS2004_RESOLUTION_0_5C UINT8_C(0x00)
+#define STTS2004_RESOLUTION_0_25C UINT8_C(0x01)
+#define STTS2004_RESOLUTION_0_125C UINT8_C(0x02)
+#define STTS2004_RESOLUTION_0_0625C UINT8_C(0x03)
+
+// Alarm flags, as latched in the temperature register by the last conversion
+#define STTS2004_ALARM_CRITICAL BIT(2) // At or above the critical limit
+#define STTS2004_ALARM_UPPER BIT(1)    // Above the upper limit
+#define STTS2004_ALARM_LOWER BIT(0)    // Below the lower limit
+
 extern int STTS2004_temperature(double *temp);
+extern int STTS2004_read(double *temp, uint8_t *alarms);
+extern int STTS2004_set_resolution(uint8_t resolution);
+
+// Alarm window and critical limit in Celsius, 0.25 C steps. With the EVENT pin enabled
+// it is asserted while the temperature is outside the window or above the critical limit.
+extern int STTS2004_set_limits(double lower, double upper, double critical);
+extern int STTS2004_event_enable(void);
+extern int STTS2004_event_disable(void);
+extern int STTS2004_wait_event(k_timeout_t timeout);
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <zephyr/sys/util.h>
+#include "iim42652.h"
+
+// Binary telemetry frame, all fields little endian:
+//
+//   0  u8   TELEMETRY_MAGIC, never '{' so JSON and binary frames can share the stream
+//   1  u8   TELEMETRY_VERSION
+//   2  u16  Sequence number, wraps
+//   4  u32  Sample time, low 32 bits of the uptime in us
+//   8  u8   Sensor mask, TELEMETRY_SENSOR_*
+//   9  u8   Payload length
+//  10  ...  One record per bit of the mask, in bit order
+//   n  u16  CRC-16/CCITT-FALSE of everything before it
+#define TELEMETRY_MAGIC 0xA5
+#define TELEMETRY_VERSION 1
+#define TELEMETRY_HEADER_SIZE 10
+#define TELEMETRY_CRC_SIZE 2
+
+// Records, fixed point int16 unless noted
+#define TELEMETRY_SENSOR_ACC BIT(0)      // int16[3], mg
+#define TELEMETRY_SENSOR_GYRO BIT(1)     // int16[3], 0.1 dps
+#define TELEMETRY_SENSOR_IMU_TEMP BIT(2) // 0.01 C
+#define TELEMETRY_SENSOR_TEMP BIT(3)     // 0.01 C
+#define TELEMETRY_SENSOR_VOLTAGE BIT(4)  // uint16, mV
+
+#define TELEMETRY_FRAME_MAX (TELEMETRY_HEADER_SIZE + 3 * 2 + 3 * 2 + 2 + 2 + 2 + TELEMETRY_CRC_SIZE)
+
+// Delta coded block of IMU samples, same header with TELEMETRY_FLAG_DELTA in the mask
+// and the time of the first sample. The payload holds all samples of the block:
+//
+//   u8   Sample count
+//   u16  Sequence number of the block the deltas continue from, absent in keyframes
+//   Per sample, for all but the first the time since the previous sample in us as a
+//   varint, then one zig-zag varint per IMU field (acc xyz, gyro xyz, imu_temp, same
+//   fixed point as above) holding the difference to the previous sample. A keyframe
+//   starts from zero, a block whose base was lost is skipped until the next keyframe.
+#define TELEMETRY_FLAG_KEYFRAME BIT(6)
+#define TELEMETRY_FLAG_DELTA BIT(7)
+#define TELEMETRY_KEYFRAME_INTERVAL 16 // Blocks, bounds what a lost block takes with it
+#define TELEMETRY_BLOCK_MAX 244
+#define TELEMETRY_BLOCK_FIELDS 7
+
+typedef struct
+{
+    uint64_t timestamp_ns; // Uptime of the sample
+    uint8_t sensors;       // TELEMETRY_SENSOR_* present below
+    float temperature; // C
+    float voltage;     // V
+    iim42652_data_t imu;
+} telemetry_sample_t;
+
+// Delta coder state, one per stream of IMU samples
+typedef struct
+{
+    uint8_t *buf;
+    size_t size;
+    size_t len; // Block bytes in buf, CRC excluded
+    uint8_t count;
+    bool keyframe;
+    bool synced;      // last and last_seq describe a block that was sent
+    uint8_t blocks;   // Blocks since the last keyframe
+    uint16_t last_seq;
+    uint64_t first_ns; // Time of the first sample of the block
+    uint64_t last_ns;
+    int16_t last[TELEMETRY_BLOCK_FIELDS];
+} telemetry_stream_t;
+
+// Encode one sample into buf, returns the frame length or -ENOMEM if size is too small
+extern int telemetry_encode(const telemetry_sample_t *sample, uint8_t *buf, size_t size);
+
+// Build one block in buf, at most size bytes. telemetry_block_add returns -ENOSPC once
+// the block is full, end it and add the sample to the next one. telemetry_block_end
+// returns the frame length, 0 for an empty block.
+extern void telemetry_stream_reset(telemetry_stream_t *stream);
+extern void telemetry_block_begin(telemetry_stream_t *stream, uint8_t *buf, size_t size);
+extern int telemetry_block_add(telemetry_stream_t *stream, const iim42652_data_t *imu, uint64_t timestamp_ns);
+extern int telemetry_block_end(telemetry_stream_t *stream);
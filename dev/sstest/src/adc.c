@@ -6,13 +6,110 @@
 
 #define ADC_NODE DT_NODELABEL(adc)
 #define ADC_CHANNEL_ID 5
-#define ADC_RESOLUTION 12
+#define ADC_RESOLUTION 14
 #define ADC_GAIN ADC_GAIN_1_6
 #define ADC_REFERENCE ADC_REF_INTERNAL
 #define ADC_ACQUISITION_TIME ADC_ACQ_TIME_DEFAULT
+#define ADC_VREF_UV (600000 * 6) // Vref = 0.6 V, Gain = 1/6
+
+// Continuous sampling: the SAADC timer triggers one conversion every ADC_INTERVAL_US,
+// each averaging 2^ADC_OVERSAMPLING samples in hardware. The results go through an
+// exponential filter with a time constant of about 2^ADC_FILTER_SHIFT intervals.
+#define ADC_INTERVAL_US 100000 // 10 Hz
+#define ADC_OVERSAMPLING 4     // 16x
+#define ADC_FILTER_SHIFT 3
+// Offset calibration drifts with temperature, redone every ADC_CALIBRATION_SAMPLES
+#define ADC_CALIBRATION_SAMPLES 600 // 1 min
 
 static const struct device *adc_dev = NULL;
 
+// DMA target of the SAADC, one result rewritten by every conversion
+static int16_t adc_sample;
+
+// Filtered value shared with the readers, updated from the SAADC interrupt
+static struct
+{
+    struct k_spinlock lock;
+    int32_t filtered;  // Raw value scaled by 2^ADC_FILTER_SHIFT
+    uint32_t samples;  // Conversions since the last (re)start
+    uint32_t total;    // Conversions since boot
+} adc_state;
+
+static void adc_restart(struct k_work *work);
+static K_WORK_DEFINE(adc_restart_work, adc_restart);
+
+static enum adc_action adc_sampling_done(const struct device *dev, const struct adc_sequence *sequence,
+                                         uint16_t sampling_index)
+{
+    ARG_UNUSED(dev);
+    ARG_UNUSED(sequence);
+    ARG_UNUSED(sampling_index);
+
+    int32_t sample = MAX(adc_sample, 0);
+
+    k_spinlock_key_t key = k_spin_lock(&adc_state.lock);
+    if (adc_state.total == 0)
+    {
+        adc_state.filtered = sample << ADC_FILTER_SHIFT;
+    }
+    else
+    {
+        adc_state.filtered += sample - (adc_state.filtered >> ADC_FILTER_SHIFT);
+    }
+    adc_state.total++;
+    bool calibrate = ++adc_state.samples >= ADC_CALIBRATION_SAMPLES;
+    k_spin_unlock(&adc_state.lock, key);
+
+    if (calibrate)
+    {
+        // The offset calibration only runs when a sequence starts, end this one
+        k_work_submit(&adc_restart_work);
+        return ADC_ACTION_FINISH;
+    }
+    // Same buffer, the next conversion is started by the interval timer
+    return ADC_ACTION_REPEAT;
+}
+
+static const struct adc_sequence_options adc_options = {
+    .interval_us = ADC_INTERVAL_US,
+    .callback = adc_sampling_done,
+    .user_data = NULL,
+    .extra_samplings = 0,
+};
+
+static struct adc_sequence adc_seq = {
+    .options = &adc_options,
+    .channels = BIT(ADC_CHANNEL_ID),
+    .buffer = &adc_sample,
+    .buffer_size = sizeof(adc_sample),
+    .resolution = ADC_RESOLUTION,
+    .oversampling = ADC_OVERSAMPLING,
+    .calibrate = true,
+};
+
+// Start a calibrated sequence that keeps sampling until the next calibration is due
+static int adc_start(void)
+{
+    k_spinlock_key_t key = k_spin_lock(&adc_state.lock);
+    adc_state.samples = 0;
+    k_spin_unlock(&adc_state.lock, key);
+
+    // No completion signal, the sequence only ends when adc_sampling_done asks for it
+    int ret = adc_read_async(adc_dev, &adc_seq, NULL);
+    if (ret)
+    {
+        printk("ADC start failed (%d)\n", ret);
+    }
+    return ret;
+}
+
+static void adc_restart(struct k_work *work)
+{
+    ARG_UNUSED(work);
+
+    adc_start();
+}
+
 int adc_init(void)
 {
     adc_dev = DEVICE_DT_GET(ADC_NODE);
@@ -37,9 +134,10 @@ int adc_init(void)
         printk("ADC channel setup failed (%d)\n", ret);
         return ret;
     }
-    return 0;
+    return adc_start();
 }
 
+// Latest filtered voltage, never blocks. -EAGAIN until the first conversion completed.
 int adc_measure(double *voltage)
 {
     if (!adc_dev)
@@ -48,22 +146,17 @@ int adc_measure(double *voltage)
         return -ENODEV;
     }
 
-    int16_t buf;
-    struct adc_sequence sequence = {
-        .channels = BIT(ADC_CHANNEL_ID),
-        .buffer = &buf,
-        .buffer_size = sizeof(buf),
-        .resolution = ADC_RESOLUTION,
-    };
+    k_spinlock_key_t key = k_spin_lock(&adc_state.lock);
+    int32_t filtered = adc_state.filtered;
+    uint32_t total = adc_state.total;
+    k_spin_unlock(&adc_state.lock, key);
 
-    int ret = adc_read(adc_dev, &sequence);
-    if (ret)
+    if (total == 0)
     {
-        printk("ADC read failed (%d)\n", ret);
-        return ret;
+        return -EAGAIN;
     }
 
-    const double vref = 0.6 * 6.0; // Vref  = 0.6 Gain = 1/6, adjust as needed
-    *voltage = ((double)buf / (1 << ADC_RESOLUTION)) * vref;
+    int64_t microvolts = ((int64_t)filtered * ADC_VREF_UV) >> (ADC_RESOLUTION + ADC_FILTER_SHIFT);
+    *voltage = (double)microvolts / 1e6;
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,122 @@
+#include "battery.h"
+#include "adc.h"
+#include <zephyr/kernel.h>
+#include <zephyr/sys/util.h>
+
+// Two alkaline AA cells in series, the supply seen by the SAADC (3.6 V full scale)
+#define BATTERY_CAPACITY_UAH 2500000U
+#define BATTERY_RESISTANCE_MOHM 600 // Internal resistance of the pack, rises as it drains
+
+// Policy thresholds in %, a level is left again only BATTERY_HYSTERESIS above its threshold
+#define BATTERY_LOW_SOC 30.0f
+#define BATTERY_CRITICAL_SOC 10.0f
+#define BATTERY_HYSTERESIS 5.0f
+
+// SoC low-pass, 1/8 of the new estimate per update (time constant ~80 s)
+#define BATTERY_FILTER_SHIFT 3
+
+// Open circuit voltage to state of charge at room temperature, piecewise linear
+static const struct
+{
+    uint16_t mv;
+    uint8_t soc;
+} battery_curve[] = {
+    {2000, 0}, {2200, 5}, {2360, 10}, {2480, 20}, {2560, 30}, {2620, 40},
+    {2680, 50}, {2740, 60}, {2800, 70}, {2880, 80}, {2980, 90}, {3200, 100},
+};
+
+static struct
+{
+    struct k_spinlock lock;
+    battery_state_t state;
+    bool valid;
+} battery = {
+    .state = {.soc = 100.0f, .load_ua = 1000},
+};
+
+static float battery_soc_from_mv(double mv)
+{
+    if (mv <= battery_curve[0].mv)
+    {
+        return 0.0f;
+    }
+    for (size_t i = 1; i < ARRAY_SIZE(battery_curve); i++)
+    {
+        if (mv < battery_curve[i].mv)
+        {
+            double span = battery_curve[i].mv - battery_curve[i - 1].mv;
+            double f = (mv - battery_curve[i - 1].mv) / span;
+            return battery_curve[i - 1].soc + (float)(f * (battery_curve[i].soc - battery_curve[i - 1].soc));
+        }
+    }
+    return 100.0f;
+}
+
+static uint8_t battery_level(uint8_t level, float soc)
+{
+    if (soc < BATTERY_CRITICAL_SOC)
+    {
+        return BATTERY_LEVEL_CRITICAL;
+    }
+    if (soc < BATTERY_LOW_SOC)
+    {
+        // Leave critical only with some margin, the voltage recovers when the load drops
+        return (level == BATTERY_LEVEL_CRITICAL && soc < BATTERY_CRITICAL_SOC + BATTERY_HYSTERESIS)
+                   ? BATTERY_LEVEL_CRITICAL
+                   : BATTERY_LEVEL_LOW;
+    }
+    if (level != BATTERY_LEVEL_NORMAL && soc < BATTERY_LOW_SOC + BATTERY_HYSTERESIS)
+    {
+        return BATTERY_LEVEL_LOW;
+    }
+    return BATTERY_LEVEL_NORMAL;
+}
+
+// Average current drawn from the battery, from the known duty cycle of the radio and the
+// sensors. Used for the load compensation and the runtime estimate.
+void battery_set_load(uint32_t load_ua)
+{
+    k_spinlock_key_t key = k_spin_lock(&battery.lock);
+    battery.state.load_ua = MAX(load_ua, 1U);
+    k_spin_unlock(&battery.lock, key);
+}
+
+// New estimate from the filtered ADC voltage
+int battery_update(void)
+{
+    double voltage;
+
+    int rc = adc_measure(&voltage);
+    if (rc != 0)
+    {
+        return rc;
+    }
+
+    k_spinlock_key_t key = k_spin_lock(&battery.lock);
+    battery_state_t *state = &battery.state;
+    // The measured voltage sags by I * R under load
+    state->voltage = voltage;
+    state->ocv = voltage + (double)state->load_ua * BATTERY_RESISTANCE_MOHM / 1e9;
+    float soc = battery_soc_from_mv(state->ocv * 1000.0);
+    if (!battery.valid)
+    {
+        state->soc = soc;
+        battery.valid = true;
+    }
+    else
+    {
+        state->soc += (soc - state->soc) / (1 << BATTERY_FILTER_SHIFT);
+    }
+    uint64_t remaining_uah = (uint64_t)(state->soc / 100.0f * BATTERY_CAPACITY_UAH);
+    state->runtime_min = (uint32_t)MIN(remaining_uah * 60U / state->load_ua, UINT32_MAX);
+    state->level = battery_level(state->level, state->soc);
+    k_spin_unlock(&battery.lock, key);
+    return 0;
+}
+
+void battery_get(battery_state_t *state)
+{
+    k_spinlock_key_t key = k_spin_lock(&battery.lock);
+    *state = battery.state;
+    k_spin_unlock(&battery.lock, key);
+}
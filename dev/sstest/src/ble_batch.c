@@ -0,0 +1,187 @@
+#include "ble_batch.h"
+#include "ble_nus.h"
+#include "ble_l2cap.h"
+#include <zephyr/kernel.h>
+#include <zephyr/sys/util.h>
+#include <string.h>
+
+// Largest notification payload, CONFIG_BT_L2CAP_TX_MTU less the ATT opcode and handle
+#define BLE_BATCH_NUS_SIZE (CONFIG_BT_L2CAP_TX_MTU - 3)
+#define BLE_BATCH_SIZE MAX(BLE_BATCH_NUS_SIZE, BLE_L2CAP_SDU_MAX)
+
+// Deadline work retry while a producer is sending or the stack is out of TX buffers
+#define BLE_BATCH_RETRY_MS 10
+
+static void ble_batch_deadline(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(ble_batch_work, ble_batch_deadline);
+// Batch being filled and the statistics, only held for copies, never across a send
+static K_MUTEX_DEFINE(ble_batch_lock);
+// Serializes the senders and owns ble_batch_tx, held across the send
+static K_MUTEX_DEFINE(ble_batch_tx_lock);
+
+static struct
+{
+    uint8_t buf[BLE_BATCH_SIZE];
+    uint16_t len;
+    uint16_t frames;
+    uint16_t size; // Payload size of the transport when the batch was started
+    bool l2cap;    // Batch goes out as an L2CAP SDU rather than a notification
+    ble_batch_stats_t stats;
+} ble_batch;
+
+// Batch taken out of ble_batch for sending, the producers keep filling the next one
+static struct
+{
+    uint8_t buf[BLE_BATCH_SIZE];
+    uint16_t len;
+    uint16_t frames;
+    uint16_t size;
+    bool l2cap;
+} ble_batch_tx;
+
+// Send ble_batch_tx, called with ble_batch_tx_lock held. The deadline runs on the system
+// workqueue, where waiting for a TX buffer would hold up the work that frees it: it does
+// not wait and keeps the batch for a retry when the stack is full.
+static int ble_batch_send_tx(bool deadline)
+{
+    int rc;
+
+    if (ble_batch_tx.l2cap)
+    {
+        rc = ble_l2cap_send(ble_batch_tx.buf, ble_batch_tx.len, deadline ? K_NO_WAIT : BLE_L2CAP_TX_TIMEOUT);
+    }
+    else
+    {
+        // The host does not wait for buffers on the system workqueue either
+        rc = ble_send(ble_batch_tx.buf, ble_batch_tx.len);
+    }
+    if (rc == -ENOMEM && deadline)
+    {
+        k_work_reschedule(&ble_batch_work, K_MSEC(BLE_BATCH_RETRY_MS));
+        return rc;
+    }
+
+    k_mutex_lock(&ble_batch_lock, K_FOREVER);
+    if (rc < 0)
+    {
+        ble_batch.stats.dropped += ble_batch_tx.frames;
+    }
+    else
+    {
+        ble_batch.stats.notifications++;
+        ble_batch.stats.frames += ble_batch_tx.frames;
+        ble_batch.stats.bytes += ble_batch_tx.len;
+        ble_batch.stats.capacity += ble_batch_tx.size;
+        if (deadline)
+        {
+            ble_batch.stats.deadline_flushes++;
+        }
+    }
+    k_mutex_unlock(&ble_batch_lock);
+    ble_batch_tx.len = 0;
+    return rc;
+}
+
+// Send the pending batch, called with ble_batch_tx_lock held
+static void ble_batch_send(bool deadline)
+{
+    // A batch the deadline could not send goes first, in order
+    if (ble_batch_tx.len > 0 && ble_batch_send_tx(deadline) == -ENOMEM && deadline)
+    {
+        return;
+    }
+
+    k_mutex_lock(&ble_batch_lock, K_FOREVER);
+    memcpy(ble_batch_tx.buf, ble_batch.buf, ble_batch.len);
+    ble_batch_tx.len = ble_batch.len;
+    ble_batch_tx.frames = ble_batch.frames;
+    ble_batch_tx.size = ble_batch.size;
+    ble_batch_tx.l2cap = ble_batch.l2cap;
+    ble_batch.len = 0;
+    ble_batch.frames = 0;
+    k_mutex_unlock(&ble_batch_lock);
+
+    if (ble_batch_tx.len > 0)
+    {
+        ble_batch_send_tx(deadline);
+    }
+}
+
+// Runs on the system workqueue, which also runs the Bluetooth host: never wait for a
+// producer that is busy sending, try again shortly instead
+static void ble_batch_deadline(struct k_work *work)
+{
+    ARG_UNUSED(work);
+
+    if (k_mutex_lock(&ble_batch_tx_lock, K_NO_WAIT) != 0)
+    {
+        k_work_reschedule(&ble_batch_work, K_MSEC(BLE_BATCH_RETRY_MS));
+        return;
+    }
+    ble_batch_send(true);
+    k_mutex_unlock(&ble_batch_tx_lock);
+}
+
+// Size of the next batch, 0 when there is no connection
+uint16_t ble_batch_capacity(void)
+{
+    uint16_t size = ble_l2cap_sdu_size();
+    if (size == 0)
+    {
+        // The payload size follows the MTU negotiated with the central
+        size = MIN(ble_payload_size(), BLE_BATCH_NUS_SIZE);
+    }
+    return MIN(size, BLE_BATCH_SIZE);
+}
+
+// Append one frame, sending the batch first if the frame does not fit anymore
+int ble_batch_add(const void *frame, uint16_t len)
+{
+    k_mutex_lock(&ble_batch_lock, K_FOREVER);
+
+    while (ble_batch.len > 0 && ble_batch.len + len > ble_batch.size)
+    {
+        // The send takes the batch out, another producer may have refilled it meanwhile
+        k_mutex_unlock(&ble_batch_lock);
+        ble_batch_flush();
+        k_mutex_lock(&ble_batch_lock, K_FOREVER);
+    }
+    if (ble_batch.len == 0)
+    {
+        // The L2CAP channel while the central keeps it open, NUS otherwise
+        ble_batch.size = ble_batch_capacity();
+        ble_batch.l2cap = ble_l2cap_sdu_size() > 0;
+        if (len > ble_batch.size)
+        {
+            ble_batch.stats.dropped++;
+            k_mutex_unlock(&ble_batch_lock);
+            return ble_batch.size == 0 ? -ENOTCONN : -EMSGSIZE;
+        }
+        k_work_reschedule(&ble_batch_work, K_MSEC(BLE_BATCH_DEADLINE_MS));
+    }
+    memcpy(&ble_batch.buf[ble_batch.len], frame, len);
+    ble_batch.len += len;
+    ble_batch.frames++;
+
+    k_mutex_unlock(&ble_batch_lock);
+    return 0;
+}
+
+void ble_batch_flush(void)
+{
+    k_mutex_lock(&ble_batch_tx_lock, K_FOREVER);
+    ble_batch_send(false);
+    k_mutex_unlock(&ble_batch_tx_lock);
+}
+
+// Fill ratio is bytes / capacity, frames / notifications the samples per notification
+void ble_batch_stats(ble_batch_stats_t *stats, bool reset)
+{
+    k_mutex_lock(&ble_batch_lock, K_FOREVER);
+    *stats = ble_batch.stats;
+    if (reset)
+    {
+        memset(&ble_batch.stats, 0, sizeof(ble_batch.stats));
+    }
+    k_mutex_unlock(&ble_batch_lock);
+}
@@ -0,0 +1,127 @@
+#include "ble_l2cap.h"
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/l2cap.h>
+#include <zephyr/net/buf.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/printk.h>
+#include <string.h>
+
+// SDUs in flight. A buffer comes back once the peer granted the credits for all of
+// its PDUs, so a full pool is the flow control of the producers.
+#define BLE_L2CAP_TX_BUFS 4
+// Nothing but the stream goes over the channel, the receive side stays minimal
+#define BLE_L2CAP_RX_MTU 64
+
+NET_BUF_POOL_FIXED_DEFINE(ble_l2cap_tx_pool, BLE_L2CAP_TX_BUFS, BT_L2CAP_SDU_BUF_SIZE(BLE_L2CAP_SDU_MAX),
+                          CONFIG_BT_CONN_TX_USER_DATA_SIZE, NULL);
+
+static struct bt_l2cap_le_chan ble_l2cap_chan;
+static atomic_t ble_l2cap_up;
+
+static void ble_l2cap_connected(struct bt_l2cap_chan *chan)
+{
+    struct bt_l2cap_le_chan *le_chan = CONTAINER_OF(chan, struct bt_l2cap_le_chan, chan);
+
+    printk("L2CAP channel connected, SDU %u, PDU %u\n", le_chan->tx.mtu, le_chan->tx.mps);
+    atomic_set(&ble_l2cap_up, 1);
+}
+
+static void ble_l2cap_disconnected(struct bt_l2cap_chan *chan)
+{
+    ARG_UNUSED(chan);
+
+    printk("L2CAP channel disconnected\n");
+    atomic_set(&ble_l2cap_up, 0);
+}
+
+static int ble_l2cap_recv(struct bt_l2cap_chan *chan, struct net_buf *buf)
+{
+    ARG_UNUSED(chan);
+    ARG_UNUSED(buf);
+
+    // Commands go through NUS, anything received here is dropped
+    return 0;
+}
+
+static const struct bt_l2cap_chan_ops ble_l2cap_ops = {
+    .connected = ble_l2cap_connected,
+    .disconnected = ble_l2cap_disconnected,
+    .recv = ble_l2cap_recv,
+};
+
+// One channel at a time
+static int ble_l2cap_accept(struct bt_conn *conn, struct bt_l2cap_server *server, struct bt_l2cap_chan **chan)
+{
+    ARG_UNUSED(conn);
+    ARG_UNUSED(server);
+
+    if (ble_l2cap_chan.chan.conn)
+    {
+        return -ENOMEM;
+    }
+    memset(&ble_l2cap_chan, 0, sizeof(ble_l2cap_chan));
+    ble_l2cap_chan.chan.ops = &ble_l2cap_ops;
+    ble_l2cap_chan.rx.mtu = BLE_L2CAP_RX_MTU;
+    *chan = &ble_l2cap_chan.chan;
+    return 0;
+}
+
+static struct bt_l2cap_server ble_l2cap_server = {
+    .psm = BLE_L2CAP_PSM,
+    .sec_level = BT_SECURITY_L1,
+    .accept = ble_l2cap_accept,
+};
+
+// Call once Bluetooth is enabled
+int ble_l2cap_init(void)
+{
+    int err = bt_l2cap_server_register(&ble_l2cap_server);
+    if (err)
+    {
+        printk("Failed to register L2CAP server: %d\n", err);
+    }
+    return err;
+}
+
+// Largest SDU the peer accepts, 0 while the channel is closed
+uint16_t ble_l2cap_sdu_size(void)
+{
+    if (!atomic_get(&ble_l2cap_up))
+    {
+        return 0;
+    }
+    return MIN(ble_l2cap_chan.tx.mtu, BLE_L2CAP_SDU_MAX);
+}
+
+// Queue one SDU, waits up to timeout for a free buffer. The buffers are freed by the
+// TX processing of the host, callers on the system workqueue must pass K_NO_WAIT.
+int ble_l2cap_send(const void *data, uint16_t len, k_timeout_t timeout)
+{
+    if (!atomic_get(&ble_l2cap_up))
+    {
+        return -ENOTCONN;
+    }
+    if (len > ble_l2cap_sdu_size())
+    {
+        return -EMSGSIZE;
+    }
+
+    struct net_buf *buf = net_buf_alloc(&ble_l2cap_tx_pool, timeout);
+    if (!buf)
+    {
+        // The peer is not handing out credits fast enough
+        return -ENOMEM;
+    }
+    net_buf_reserve(buf, BT_L2CAP_SDU_CHAN_SEND_RESERVE);
+    net_buf_add_mem(buf, data, len);
+
+    int rc = bt_l2cap_chan_send(&ble_l2cap_chan.chan, buf);
+    if (rc < 0)
+    {
+        net_buf_unref(buf);
+        return rc;
+    }
+    return 0;
+}
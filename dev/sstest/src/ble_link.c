@@ -0,0 +1,247 @@
+// Link manager: once connected the peripheral asks for the MTU, data length, PHY and
+// connection parameters of the selected profile instead of living with what the
+// central picked. The steps run one after the other from the system workqueue, each
+// one advanced by its completion event or, if the central ignores it, a timeout.
+#include "ble_link.h"
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/gatt.h>
+#include <zephyr/sys/printk.h>
+#include <zephyr/sys/util.h>
+
+// Let the central finish its own connection setup (discovery, CCC writes) first
+#define BLE_LINK_START_DELAY K_MSEC(200)
+#define BLE_LINK_STEP_TIMEOUT K_MSEC(1000)
+
+enum
+{
+    BLE_LINK_STEP_MTU,
+    BLE_LINK_STEP_DATA_LEN,
+    BLE_LINK_STEP_PHY,
+    BLE_LINK_STEP_PARAM,
+    BLE_LINK_STEP_DONE,
+};
+
+typedef struct
+{
+    struct bt_conn_le_data_len_param data_len;
+    struct bt_conn_le_phy_param phy;
+    struct bt_le_conn_param param;
+} ble_link_profile_t;
+
+static const ble_link_profile_t ble_link_profiles[] = {
+    [BLE_LINK_PROFILE_STREAMING] = {
+        .data_len = {BT_GAP_DATA_LEN_MAX, BT_GAP_DATA_TIME_MAX},
+        .phy = {BT_CONN_LE_PHY_OPT_NONE, BT_GAP_LE_PHY_2M, BT_GAP_LE_PHY_2M},
+        .param = {6, 12, 0, 400}, // 7.5-15 ms, 4 s supervision
+    },
+    [BLE_LINK_PROFILE_IDLE] = {
+        .data_len = {BT_GAP_DATA_LEN_DEFAULT, BT_GAP_DATA_TIME_DEFAULT},
+        .phy = {BT_CONN_LE_PHY_OPT_NONE, BT_GAP_LE_PHY_1M, BT_GAP_LE_PHY_1M},
+        .param = {80, 160, 4, 600}, // 100-200 ms, 4 skipped events, 6 s supervision
+    },
+};
+
+static struct
+{
+    struct bt_conn *conn;
+    uint8_t step;
+    bool mtu_exchanged; // The ATT MTU can only be exchanged once per connection
+    ble_link_info_t info;
+    ble_link_report_cb_t report_cb;
+} ble_link = {
+    .info.profile = BLE_LINK_PROFILE_STREAMING,
+};
+
+static struct bt_gatt_exchange_params ble_link_mtu_params;
+
+static void ble_link_work_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(ble_link_work, ble_link_work_handler);
+
+// Completion event of a step, go on with the next one without waiting for the timeout.
+// Events the central initiated itself come outside of a step and only update the info.
+static void ble_link_step_done(struct bt_conn *conn, uint8_t step)
+{
+    if (conn == ble_link.conn && ble_link.step == step + 1)
+    {
+        k_work_reschedule(&ble_link_work, K_NO_WAIT);
+    }
+}
+
+static void ble_link_mtu_exchanged(struct bt_conn *conn, uint8_t err, struct bt_gatt_exchange_params *params)
+{
+    ARG_UNUSED(params);
+
+    if (err)
+    {
+        printk("MTU exchange failed (err %u)\n", err);
+    }
+    ble_link.info.mtu = bt_gatt_get_mtu(conn);
+    ble_link_step_done(conn, BLE_LINK_STEP_MTU);
+}
+
+static void ble_link_report(void)
+{
+    const ble_link_info_t *info = &ble_link.info;
+
+    printk("Link: MTU %u, data length %u/%u, PHY %u/%u, interval %u, latency %u, timeout %u\n", info->mtu,
+           info->tx_octets, info->rx_octets, info->tx_phy, info->rx_phy, info->interval, info->latency,
+           info->timeout);
+    if (ble_link.report_cb)
+    {
+        ble_link.report_cb(info);
+    }
+}
+
+static void ble_link_work_handler(struct k_work *work)
+{
+    const ble_link_profile_t *profile = &ble_link_profiles[ble_link.info.profile];
+    struct bt_conn *conn = ble_link.conn;
+    int err = 0;
+
+    ARG_UNUSED(work);
+
+    if (!conn)
+    {
+        return;
+    }
+
+    switch (ble_link.step)
+    {
+    case BLE_LINK_STEP_MTU:
+        if (ble_link.mtu_exchanged)
+        {
+            ble_link.step++;
+            k_work_reschedule(&ble_link_work, K_NO_WAIT);
+            return;
+        }
+        ble_link.mtu_exchanged = true;
+        ble_link_mtu_params.func = ble_link_mtu_exchanged;
+        err = bt_gatt_exchange_mtu(conn, &ble_link_mtu_params);
+        break;
+    case BLE_LINK_STEP_DATA_LEN:
+        err = bt_conn_le_data_len_update(conn, &profile->data_len);
+        break;
+    case BLE_LINK_STEP_PHY:
+        err = bt_conn_le_phy_update(conn, &profile->phy);
+        break;
+    case BLE_LINK_STEP_PARAM:
+        err = bt_conn_le_param_update(conn, &profile->param);
+        break;
+    default:
+        ble_link_report();
+        return;
+    }
+
+    if (err)
+    {
+        // Already in effect (-EALREADY) or refused, skip to the next step
+        if (err != -EALREADY)
+        {
+            printk("Link step %u failed (err %d)\n", ble_link.step, err);
+        }
+        ble_link.step++;
+        k_work_reschedule(&ble_link_work, K_NO_WAIT);
+        return;
+    }
+    // Wait for the completion event, or move on if the central never answers
+    ble_link.step++;
+    k_work_reschedule(&ble_link_work, BLE_LINK_STEP_TIMEOUT);
+}
+
+static void ble_link_connected(struct bt_conn *conn, uint8_t err)
+{
+    struct bt_conn_info info;
+
+    if (err || bt_conn_get_info(conn, &info) != 0 || info.role != BT_CONN_ROLE_PERIPHERAL)
+    {
+        return;
+    }
+
+    ble_link.conn = bt_conn_ref(conn);
+    ble_link.mtu_exchanged = false;
+    ble_link.step = BLE_LINK_STEP_MTU;
+    ble_link.info.mtu = bt_gatt_get_mtu(conn);
+    ble_link.info.tx_octets = info.le.data_len->tx_max_len;
+    ble_link.info.rx_octets = info.le.data_len->rx_max_len;
+    ble_link.info.tx_phy = info.le.phy->tx_phy;
+    ble_link.info.rx_phy = info.le.phy->rx_phy;
+    ble_link.info.interval = info.le.interval;
+    ble_link.info.latency = info.le.latency;
+    ble_link.info.timeout = info.le.timeout;
+    k_work_reschedule(&ble_link_work, BLE_LINK_START_DELAY);
+}
+
+static void ble_link_disconnected(struct bt_conn *conn, uint8_t reason)
+{
+    ARG_UNUSED(reason);
+
+    if (conn != ble_link.conn)
+    {
+        return;
+    }
+    k_work_cancel_delayable(&ble_link_work);
+    bt_conn_unref(ble_link.conn);
+    ble_link.conn = NULL;
+}
+
+static void ble_link_param_updated(struct bt_conn *conn, uint16_t interval, uint16_t latency, uint16_t timeout)
+{
+    ble_link.info.interval = interval;
+    ble_link.info.latency = latency;
+    ble_link.info.timeout = timeout;
+    ble_link_step_done(conn, BLE_LINK_STEP_PARAM);
+}
+
+static void ble_link_phy_updated(struct bt_conn *conn, struct bt_conn_le_phy_info *param)
+{
+    ble_link.info.tx_phy = param->tx_phy;
+    ble_link.info.rx_phy = param->rx_phy;
+    ble_link_step_done(conn, BLE_LINK_STEP_PHY);
+}
+
+static void ble_link_data_len_updated(struct bt_conn *conn, struct bt_conn_le_data_len_info *info)
+{
+    ble_link.info.tx_octets = info->tx_max_len;
+    ble_link.info.rx_octets = info->rx_max_len;
+    ble_link_step_done(conn, BLE_LINK_STEP_DATA_LEN);
+}
+
+BT_CONN_CB_DEFINE(ble_link_conn_callbacks) = {
+    .connected = ble_link_connected,
+    .disconnected = ble_link_disconnected,
+    .le_param_updated = ble_link_param_updated,
+    .le_phy_updated = ble_link_phy_updated,
+    .le_data_len_updated = ble_link_data_len_updated,
+};
+
+// Switch profile, renegotiated right away on a live connection. Called from any thread.
+void ble_link_set_profile(uint8_t profile)
+{
+    if (profile >= ARRAY_SIZE(ble_link_profiles) || profile == ble_link.info.profile)
+    {
+        return;
+    }
+    ble_link.info.profile = profile;
+    if (ble_link.conn)
+    {
+        ble_link.step = BLE_LINK_STEP_MTU;
+        k_work_reschedule(&ble_link_work, K_NO_WAIT);
+    }
+}
+
+void ble_link_set_report_cb(ble_link_report_cb_t cb)
+{
+    ble_link.report_cb = cb;
+}
+
+int ble_link_get(ble_link_info_t *info)
+{
+    if (!ble_link.conn)
+    {
+        return -ENOTCONN;
+    }
+    *info = ble_link.info;
+    return 0;
+}
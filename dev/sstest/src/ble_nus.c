@@ -1,7 +1,13 @@
 #include "ble_nus.h"
+#include "ble_l2cap.h"
 #include <zephyr/kernel.h>
 #include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/gatt.h>
+#include <zephyr/bluetooth/hci.h>
+#include <zephyr/bluetooth/hci_vs.h>
 #include <zephyr/bluetooth/services/nus.h>
+#include <zephyr/sys/byteorder.h>
 #include <zephyr/sys/printk.h>
 #include <zephyr/sys/util.h>
 #include <stdarg.h>
@@ -27,6 +33,7 @@ static const struct bt_data sd[] = {
 };
 
 static struct bt_conn *current_conn = NULL;
+static ble_rx_handler_t rx_handler = NULL;
 
 struct bt_nus_cb nus_listener = {
     .notif_enabled = notif_enabled,
@@ -41,11 +48,78 @@ static struct bt_conn_cb conn_callbacks = {
 static void adv_restart(struct k_work *work);
 static struct k_work_delayable adv_restart_work;
 
+// TX power for advertising and connections, applied from the system workqueue
+static int8_t tx_power_dbm;
+static void tx_power_apply(struct k_work *work);
+static K_WORK_DEFINE(tx_power_work, tx_power_apply);
+
 struct bt_conn *ble_connection(void)
 {
     return current_conn;
 }
 
+// Largest notification payload on the current connection, 0 when not connected
+uint16_t ble_payload_size(void)
+{
+    struct bt_conn *conn = current_conn;
+
+    return conn ? bt_gatt_get_mtu(conn) - 3 : 0;
+}
+
+void ble_set_rx_handler(ble_rx_handler_t handler)
+{
+    rx_handler = handler;
+}
+
+// Zephyr vendor specific HCI command, handle is the advertising set or the connection
+static int ble_write_tx_power(uint8_t handle_type, uint16_t handle, int8_t dbm)
+{
+#ifdef CONFIG_BT_CTLR_TX_PWR_DYNAMIC_CONTROL
+    struct bt_hci_cp_vs_write_tx_power_level *cp;
+    struct net_buf *buf = bt_hci_cmd_create(BT_HCI_OP_VS_WRITE_TX_POWER_LEVEL, sizeof(*cp));
+    if (!buf)
+    {
+        return -ENOBUFS;
+    }
+    cp = net_buf_add(buf, sizeof(*cp));
+    cp->handle = sys_cpu_to_le16(handle);
+    cp->handle_type = handle_type;
+    cp->tx_power_level = dbm;
+    return bt_hci_cmd_send_sync(BT_HCI_OP_VS_WRITE_TX_POWER_LEVEL, buf, NULL);
+#else
+    ARG_UNUSED(handle_type);
+    ARG_UNUSED(handle);
+    ARG_UNUSED(dbm);
+    return -ENOTSUP;
+#endif
+}
+
+static void tx_power_apply(struct k_work *work)
+{
+    ARG_UNUSED(work);
+
+    int err = ble_write_tx_power(BT_HCI_VS_LL_HANDLE_TYPE_ADV, 0, tx_power_dbm);
+    if (current_conn)
+    {
+        uint16_t handle;
+        if (bt_hci_get_conn_handle(current_conn, &handle) == 0)
+        {
+            err = ble_write_tx_power(BT_HCI_VS_LL_HANDLE_TYPE_CONN, handle, tx_power_dbm);
+        }
+    }
+    if (err)
+    {
+        printk("Failed to set TX power: %d\n", err);
+    }
+}
+
+// Request a TX power in dBm, the controller picks the closest supported level at or below it
+void ble_set_tx_power(int8_t dbm)
+{
+    tx_power_dbm = dbm;
+    k_work_submit(&tx_power_work);
+}
+
 int ble_init()
 {
     int err;
@@ -65,6 +139,9 @@ int ble_init()
         return err;
     }
 
+    // Bulk stream channel, NUS keeps working without it
+    ble_l2cap_init();
+
     err = bt_le_adv_start(BT_LE_ADV_CONN_FAST_1, ad, ARRAY_SIZE(ad), sd, ARRAY_SIZE(sd));
     if (err)
     {
@@ -89,6 +166,12 @@ void received(struct bt_conn *conn, const void *data, uint16_t len, void *ctx)
 
     ARG_UNUSED(ctx);
 
+    if (rx_handler)
+    {
+        rx_handler(data, len);
+        return;
+    }
+
     memcpy(message, data, MIN(sizeof(message) - 1, len));
     printk("%s() - Len: %d, Message: %s\n", __func__, len, message);
 
@@ -106,6 +189,12 @@ void connected(struct bt_conn *conn, uint8_t err)
     }
     current_conn = bt_conn_ref(conn);
     printk("Central connected\n");
+
+    // New connections start at the controller default
+    if (tx_power_dbm != 0)
+    {
+        k_work_submit(&tx_power_work);
+    }
 }
 
 static void adv_restart(struct k_work *work)
@@ -161,9 +250,15 @@ int bt_nus_printf(const char *fmt, ...)
     }
     // Ensure null-termination for safety, though bt_nus_send uses length
     buf[sizeof(buf) - 1] = '\0';
+    len = MIN(len, sizeof(buf) - 1);
 
     int total_sent = 0;
-    const int chunk_size = 253;
+    // One notification per negotiated ATT payload
+    const int chunk_size = ble_payload_size();
+    if (chunk_size == 0)
+    {
+        return -ENOTCONN;
+    }
     for (int offset = 0; offset < len; offset += chunk_size)
     {
         int send_len = (len - offset > chunk_size) ? chunk_size : (len - offset);
@@ -175,4 +270,15 @@ int bt_nus_printf(const char *fmt, ...)
         total_sent += send_len;
     }
     return total_sent;
-}
\ No newline at end of file
+}
+
+// Send a binary frame as is, in a single notification
+int ble_send(const void *data, uint16_t len)
+{
+    struct bt_conn *conn = ble_connection();
+    if (!conn)
+    {
+        return -ENOTCONN;
+    }
+    return bt_nus_send(conn, data, len);
+}
@@ -1,93 +1,516 @@
 #include "iim42652.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
 #include <zephyr/drivers/spi.h>
-#define SPI1_NODE DT_NODELABEL(spi1)
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/sys/byteorder.h>
+#ifdef CONFIG_BT_ZEPHYR_NUS
+#include "ble_nus.h"
+#endif
+#ifdef CONFIG_CPU_CORTEX_M
+#include <cmsis_core.h>
+#endif
+#ifdef CONFIG_IIM42652_CALIB_SETTINGS
+#include <zephyr/settings/settings.h>
+#endif
+// Default binding to the first enabled instance, the sensor device attaches its own config
+#define IIM42652_NODE DT_INST(0, invensense_iim42652)
 
-const struct device *spi1 = DEVICE_DT_GET(SPI1_NODE);
+#define IIM42652_SPI_MAX_FREQUENCY 24000000U // Part limit, the bus node may cap it lower
+// spi_emul has no asynchronous transfers, the FIFO drain runs synchronously behind it
+#define IIM42652_SPI_ASYNC                                                                                             \
+    (IS_ENABLED(CONFIG_SPI_ASYNC) && !DT_NODE_HAS_COMPAT(DT_BUS(IIM42652_NODE), zephyr_spi_emul_controller))
+
+// Time base correlation: the anchor follows 1/4 of the measured phase error and the
+// drift estimate 1/8 of the implied rate error, larger errors restart the correlation
+#define IIM42652_TMST_PHASE_GAIN 4
+#define IIM42652_TMST_DRIFT_GAIN 8
+#define IIM42652_TMST_RESYNC_NS 1000000 // 1 ms
+#define IIM42652_TMST_DRIFT_MAX 20000000 // 2 %, well beyond the internal oscillator tolerance
+
+// Self-test and calibration run at 1 kHz, +-4 g and +-250 dps (131 LSB/dps, 8192 LSB/g)
+#define IIM42652_ST_SAMPLES 200
+#define IIM42652_ST_SETTLE_MS 200
+#define IIM42652_ST_GYRO_LSB_PER_DPS 131.0f
+#define IIM42652_ST_ACC_LSB_PER_G 8192.0f
+// Factory self-test response in LSB is nominal * 1.01^(ST_DATA - 1)
+#define IIM42652_ST_GYRO_NOMINAL 2620.0f
+#define IIM42652_ST_ACC_NOMINAL 1310.0f
+#define IIM42652_ST_GYRO_MIN_RATIO 0.5f
+#define IIM42652_ST_ACC_MIN_RATIO 0.5f
+#define IIM42652_ST_ACC_MAX_RATIO 1.5f
+// Largest peak-to-peak per axis still accepted as a stationary capture
+#define IIM42652_CALIB_ACC_STILL_MG 50.0f
+#define IIM42652_CALIB_GYRO_STILL_DPS 3.0f
+
+// INT1 line, optional so boards without it fall back to polling
+static struct gpio_dt_spec imu_int1 =
+    GPIO_DT_SPEC_GET_OR(IIM42652_NODE, int_gpios, {0});
+static struct gpio_callback imu_int1_cb;
+static K_SEM_DEFINE(imu_int1_sem, 0, 1);
+static iim42652_event_handler_t imu_event_handler;
 
 typedef struct
 {
+    // SPI drivers cache the last used config by pointer, a frequency change
+    // therefore goes to the other slot instead of patching the active one
+    struct spi_dt_spec spi[2];
+    uint8_t spi_idx;
+    bool spi_used;          // Active slot went through the driver since the last switch
+    uint32_t max_frequency; // Part limit or the devicetree spi-max-frequency, whichever is lower
+    uint8_t bank;  // Selected register bank, IIM42652_BANK_UNKNOWN after a reset or bus error
+    // RAM shadow of the configuration registers, see IIM42652_reg_volatile
+    uint8_t shadow[IIM42652_BANKS][IIM42652_BANK_REGS];
+    uint32_t shadow_valid[IIM42652_BANKS][IIM42652_BANK_REGS / 32];
     bool initialized;
     bool data_valid;
+    bool fifo_enabled;
+    bool fifo_hires;              // 20-byte packet 4 instead of packet 3
+    bool wom_active;              // Accel in LP mode, gyro off, INT1 reports motion
+    uint16_t fifo_last_timestamp; // Last raw 16-bit FIFO timestamp
+    uint64_t fifo_timestamp;      // Unwrapped FIFO timestamp in sensor us
+    bool tmst_synced;
+    uint32_t tmst_raw;            // Last 20-bit TMSTVAL
+    uint64_t tmst_sensor_us;      // Unwrapped sensor time of the anchor
+    uint64_t tmst_uptime_ns;      // Uptime matching tmst_sensor_us
+    int32_t tmst_drift_ppb;       // Sensor clock rate error, positive when the sensor runs slow
+    uint64_t last_sample_ns;      // Keeps reconstructed sample times strictly increasing
+    uint8_t odr;                  // IIM42652_ODR_* applied to accel and gyro
+    uint8_t acc_range;            // IIM42652_RANGE_PM*G
+    uint8_t gyro_range;           // IIM42652_RANGE_PM*dps
+    uint8_t filters;              // IIM42652_UI_FILT_BW_* for both UI filters
+    iim42652_offsets_t offsets;   // OFFSET_USER content, written again by IIM42652_init
+    float acc_scale;              // g per LSB for acc_range
+    float gyro_scale;             // dps per LSB for gyro_range
 } iim42652_instance_t;
 
+// Sensitivity in LSB per unit, indexed by the FS_SEL register value
+static const float acc_lsb_per_g[] = {
+    [IIM42652_RANGE_PM16G] = 2048.0f,
+    [IIM42652_RANGE_PM8G] = 4096.0f,
+    [IIM42652_RANGE_PM4G] = 8192.0f,
+    [IIM42652_RANGE_PM2G] = 16384.0f,
+};
+
+static const float gyro_lsb_per_dps[] = {
+    [IIM42652_RANGE_PM2kdps] = 16.4f,
+    [IIM42652_RANGE_PM1kdps] = 32.8f,
+    [IIM42652_RANGE_PM500dps] = 65.5f,
+    [IIM42652_RANGE_PM250dps] = 131.0f,
+    [IIM42652_RANGE_PM125dps] = 262.0f,
+    [IIM42652_RANGE_PM62_5dps] = 524.3f,
+    [IIM42652_RANGE_PM31_25dps] = 1048.6f,
+    [IIM42652_RANGE_PM15_625dps] = 2097.2f,
+};
+
+// Output data rate in Hz, indexed by the ODR register value
+static const float odr_hz[] = {
+    [IIM42652_ODR_32KHZ] = 32000.0f,
+    [IIM42652_ODR_16KHZ] = 16000.0f,
+    [IIM42652_ODR_8KHZ] = 8000.0f,
+    [IIM42652_ODR_4KHZ] = 4000.0f,
+    [IIM42652_ODR_2KHZ] = 2000.0f,
+    [IIM42652_ODR_1KHZ] = 1000.0f,
+    [IIM42652_ODR_200HZ] = 200.0f,
+    [IIM42652_ODR_100HZ] = 100.0f,
+    [IIM42652_ODR_50HZ] = 50.0f,
+    [IIM42652_ODR_25HZ] = 25.0f,
+    [IIM42652_ODR_12_5HZ] = 12.5f,
+    [IIM42652_ODR_6_25HZ] = 6.25f,
+    [IIM42652_ODR_3_125HZ] = 3.125f,
+    [IIM42652_ODR_1_5625HZ] = 1.5625f,
+    [IIM42652_ODR_500HZ] = 500.0f,
+};
+
+BUILD_ASSERT(1000000U / IIM42652_FIFO_ODR_MIN_HZ < IIM42652_FIFO_TMST_RANGE_US,
+             "FIFO timestamp unwrap needs samples closer than one 16-bit wrap");
+
+// Rates usable with the FIFO, see IIM42652_FIFO_ODR_MIN_HZ
+static bool IIM42652_fifo_odr_valid(uint8_t odr)
+{
+    return odr < ARRAY_SIZE(odr_hz) && odr_hz[odr] >= IIM42652_FIFO_ODR_MIN_HZ;
+}
+
+// Power-on defaults: 1 kHz, +-16 g, +-2000 dps
 iim42652_instance_t iim42652_instance = {
+    .spi = {
+        SPI_DT_SPEC_GET(IIM42652_NODE, IIM42652_SPI_OPERATION, 0),
+        SPI_DT_SPEC_GET(IIM42652_NODE, IIM42652_SPI_OPERATION, 0),
+    },
+    .spi_idx = 0,
+    .max_frequency = MIN(IIM42652_SPI_MAX_FREQUENCY, DT_PROP(IIM42652_NODE, spi_max_frequency)),
+    .bank = IIM42652_BANK_UNKNOWN,
     .initialized = false,
     .data_valid = false,
+    .fifo_enabled = false,
+    .odr = IIM42652_ODR_1KHZ,
+    .acc_range = IIM42652_RANGE_PM16G,
+    .gyro_range = IIM42652_RANGE_PM2kdps,
+    .filters = IIM42652_UI_FILT_BW_ODR_DIV4,
+    .acc_scale = 1.0f / 2048.0f,
+    .gyro_scale = 1.0f / 16.4f,
 };
 
-uint8_t IIM42652_read_register(uint8_t reg)
+// Raw FIFO packets of one drain, filled in a single SPI transaction
+static uint8_t fifo_buffer[IIM42652_FIFO_MAX_PACKETS * IIM42652_FIFO_PACKET_SIZE];
+
+// Prebuilt descriptors for the hot reads, only the FIFO length changes at runtime.
+// The first rx byte is clocked in during the command and is skipped.
+static uint8_t data_cmd = IIM42652_TEMP_DATA1_UI | 0x80;
+static uint8_t data_rx[2 + 6 + 6]; // Temp 2 bytes Acc 6 bytes Gyro 6 bytes
+static const struct spi_buf data_tx_buf = {.buf = &data_cmd, .len = 1};
+static const struct spi_buf data_rx_bufs[] = {
+    {.buf = NULL, .len = 1},
+    {.buf = data_rx, .len = sizeof(data_rx)},
+};
+static const struct spi_buf_set data_tx = {.buffers = &data_tx_buf, .count = 1};
+static const struct spi_buf_set data_rx_set = {.buffers = data_rx_bufs, .count = ARRAY_SIZE(data_rx_bufs)};
+
+static uint8_t fifo_cmd = IIM42652_FIFO_DATA | 0x80;
+static const struct spi_buf fifo_tx_buf = {.buf = &fifo_cmd, .len = 1};
+static struct spi_buf fifo_rx_bufs[] = {
+    {.buf = NULL, .len = 1},
+    {.buf = fifo_buffer, .len = 0},
+};
+static const struct spi_buf_set fifo_tx = {.buffers = &fifo_tx_buf, .count = 1};
+static const struct spi_buf_set fifo_rx_set = {.buffers = fifo_rx_bufs, .count = ARRAY_SIZE(fifo_rx_bufs)};
+
+static inline const struct spi_dt_spec *IIM42652_spi(void)
 {
+    iim42652_instance.spi_used = true;
+    return &iim42652_instance.spi[iim42652_instance.spi_idx];
+}
 
-    uint8_t tx_buf[2] = {reg | 0x80, 0}; // Read command with MSB set
-    uint8_t rx_buf[2] = {0};             // Buffer to store received data
-    struct spi_buf tx = {
-        .buf = tx_buf,
-        .len = sizeof(tx_buf),
+// Raw burst read of consecutive registers (or FIFO_DATA) of the selected bank
+static int IIM42652_spi_read(uint8_t reg, uint8_t *data, size_t len)
+{
+    uint8_t tx_data = reg | 0x80; // Read command with MSB set
+    struct spi_buf tx_buf = {
+        .buf = &tx_data,
+        .len = 1,
     };
-    struct spi_buf rx = {
-        .buf = rx_buf,
-        .len = sizeof(rx_buf),
+    struct spi_buf rx_bufs[] = {
+        {
+            .buf = NULL, // Skip the byte clocked in during the command
+            .len = 1,
+        },
+        {
+            .buf = data,
+            .len = len,
+        },
     };
-    struct spi_buf_set tx_set = {
-        .buffers = &tx,
+    struct spi_buf_set tx = {
+        .buffers = &tx_buf,
         .count = 1,
     };
-    struct spi_buf_set rx_set = {
-        .buffers = &rx,
-        .count = 1,
+    struct spi_buf_set rx = {
+        .buffers = rx_bufs,
+        .count = ARRAY_SIZE(rx_bufs),
     };
-    struct spi_config spi_cfg = {
-        .frequency = 1000000U, // 1 MHz, adjust as needed
-        .operation = SPI_OP_MODE_MASTER | SPI_WORD_SET(8) | SPI_TRANSFER_MSB,
-        .slave = 0,
-        .cs = {
-            .gpio = GPIO_DT_SPEC_GET(SPI1_NODE, cs_gpios),
+    int rc = spi_transceive_dt(IIM42652_spi(), &tx, &rx);
+    if (rc < 0)
+    {
+        IIM42652_reg_cache_invalidate();
+    }
+    return rc;
+}
+
+// Raw burst write of consecutive registers of the selected bank, the address auto-increments
+static int IIM42652_spi_write(uint8_t reg, const uint8_t *values, size_t len)
+{
+    uint8_t cmd = reg & 0x7F; // Write command with MSB cleared
+    struct spi_buf tx_bufs[] = {
+        {
+            .buf = &cmd,
+            .len = 1,
+        },
+        {
+            .buf = (uint8_t *)values,
+            .len = len,
         },
     };
-    int rc = spi_transceive(spi1, &spi_cfg, &tx_set, &rx_set);
+    struct spi_buf_set tx = {
+        .buffers = tx_bufs,
+        .count = ARRAY_SIZE(tx_bufs),
+    };
+    int rc = spi_write_dt(IIM42652_spi(), &tx);
+    if (rc < 0)
+    {
+        // The write may or may not have landed, nothing in the shadow can be trusted
+        IIM42652_reg_cache_invalidate();
+    }
+    return rc;
+}
+
+static int IIM42652_select_bank(uint8_t bank)
+{
+    if (bank == iim42652_instance.bank)
+    {
+        return 0;
+    }
+    int rc = IIM42652_spi_write(IIM42652_REG_BANK_SEL, &bank, 1);
+    iim42652_instance.bank = rc < 0 ? IIM42652_BANK_UNKNOWN : bank;
+    return rc;
+}
+
+// Registers the part changes on its own (data, status, FIFO, counters, self-clearing
+// triggers) always go to the bus, everything else is served from the shadow
+static bool IIM42652_reg_volatile(uint8_t bank, uint8_t reg)
+{
+    switch (bank)
+    {
+    case IIM42652_REG_BANK_0:
+        return reg == IIM42652_DEVICE_CONFIG || (reg >= IIM42652_TEMP_DATA1_UI && reg <= IIM42652_INT_STATUS3) ||
+               reg == IIM42652_SIGNAL_PATH_RESET || reg == IIM42652_FIFO_LOST_PKT0 ||
+               reg == IIM42652_FIFO_LOST_PKT1 || reg == IIM42652_SELF_TEST_CONFIG;
+    case IIM42652_REG_BANK_1:
+        return reg >= IIM42652_TMSTVAL0 && reg <= IIM42652_TMSTVAL2;
+    default:
+        return false;
+    }
+}
+
+static bool IIM42652_reg_cached(uint8_t bank, uint8_t reg)
+{
+    return iim42652_instance.shadow_valid[bank][reg / 32] & BIT(reg % 32);
+}
+
+static void IIM42652_reg_cache_store(uint8_t bank, uint8_t reg, uint8_t value)
+{
+    if (!IIM42652_reg_volatile(bank, reg))
+    {
+        iim42652_instance.shadow[bank][reg] = value;
+        iim42652_instance.shadow_valid[bank][reg / 32] |= BIT(reg % 32);
+    }
+}
+
+// Forget the shadow and the selected bank, after a reset or a bus error
+void IIM42652_reg_cache_invalidate(void)
+{
+    memset(iim42652_instance.shadow_valid, 0, sizeof(iim42652_instance.shadow_valid));
+    iim42652_instance.bank = IIM42652_BANK_UNKNOWN;
+}
+
+// Uncached burst read of consecutive registers (or FIFO_DATA) in one transaction
+int IIM42652_reg_read_burst(uint8_t bank, uint8_t reg, uint8_t *data, size_t len)
+{
+    if (bank >= IIM42652_BANKS)
+    {
+        return -EINVAL;
+    }
+    int rc = IIM42652_select_bank(bank);
+    if (rc < 0)
+    {
+        return rc;
+    }
+    rc = IIM42652_spi_read(reg, data, len);
+    if (rc < 0)
+    {
+        return rc;
+    }
+    for (size_t i = 0; i < len && reg + i < IIM42652_BANK_REGS; i++)
+    {
+        IIM42652_reg_cache_store(bank, reg + i, data[i]);
+    }
+    return 0;
+}
+
+int IIM42652_reg_read(uint8_t bank, uint8_t reg, uint8_t *value)
+{
+    if (bank >= IIM42652_BANKS || reg >= IIM42652_BANK_REGS)
+    {
+        return -EINVAL;
+    }
+    if (IIM42652_reg_cached(bank, reg))
+    {
+        *value = iim42652_instance.shadow[bank][reg];
+        return 0;
+    }
+    return IIM42652_reg_read_burst(bank, reg, value, 1);
+}
+
+// Write consecutive registers, only the span between the first and the last register
+// that differs from the shadow goes out, as one burst. Nothing is sent when all match.
+int IIM42652_reg_write_burst(uint8_t bank, uint8_t reg, const uint8_t *values, size_t len)
+{
+    if (bank >= IIM42652_BANKS || len == 0 || reg + len > IIM42652_BANK_REGS)
+    {
+        return -EINVAL;
+    }
+
+    size_t first = len;
+    size_t last = 0;
+    for (size_t i = 0; i < len; i++)
+    {
+        uint8_t r = reg + i;
+        if (IIM42652_reg_volatile(bank, r) || !IIM42652_reg_cached(bank, r) ||
+            iim42652_instance.shadow[bank][r] != values[i])
+        {
+            first = MIN(first, i);
+            last = i;
+        }
+    }
+    if (first == len)
+    {
+        return 0;
+    }
+
+    int rc = IIM42652_select_bank(bank);
+    if (rc < 0)
+    {
+        return rc;
+    }
+    rc = IIM42652_spi_write(reg + first, &values[first], last - first + 1);
+    if (rc < 0)
+    {
+        return rc;
+    }
+    for (size_t i = first; i <= last; i++)
+    {
+        IIM42652_reg_cache_store(bank, reg + i, values[i]);
+    }
+    return 0;
+}
+
+int IIM42652_reg_write(uint8_t bank, uint8_t reg, uint8_t value)
+{
+    return IIM42652_reg_write_burst(bank, reg, &value, 1);
+}
+
+// Read-modify-write of the bits in mask, the read is normally served from the shadow
+int IIM42652_reg_update(uint8_t bank, uint8_t reg, uint8_t mask, uint8_t value)
+{
+    uint8_t current;
+
+    int rc = IIM42652_reg_read(bank, reg, &current);
+    if (rc < 0)
+    {
+        return rc;
+    }
+    return IIM42652_reg_write(bank, reg, (current & ~mask) | (value & mask));
+}
+
+// Bank 0 shorthands
+int IIM42652_read_burst(uint8_t reg, uint8_t *data, size_t len)
+{
+    return IIM42652_reg_read_burst(IIM42652_REG_BANK_0, reg, data, len);
+}
+
+uint8_t IIM42652_read_register(uint8_t reg)
+{
+    uint8_t value = 0;
+
+    int rc = IIM42652_reg_read(IIM42652_REG_BANK_0, reg, &value);
     if (rc < 0)
     {
         return 0; // Return an error value
     }
-    return rx_buf[1]; // Return the read value
+    return value; // Return the read value
 }
 
 void IIM42652_write_register(uint8_t reg, uint8_t value)
 {
-
-    uint8_t tx_buf[2] = {reg & 0x7F, value}; // Write command with MSB cleared
-    struct spi_buf tx = {
-        .buf = tx_buf,
-        .len = sizeof(tx_buf),
-    };
-    struct spi_buf_set tx_set = {
-        .buffers = &tx,
-        .count = 1,
-    };
-    struct spi_config spi_cfg = {
-        .frequency = 1000000U, // 1 MHz, adjust as needed
-        .operation = SPI_OP_MODE_MASTER | SPI_WORD_SET(8) | SPI_TRANSFER_MSB,
-        .slave = 0,
-        .cs = {
-            .gpio = GPIO_DT_SPEC_GET(SPI1_NODE, cs_gpios),
-        },
-    };
-    int rc = spi_write(spi1, &spi_cfg, &tx_set);
+    int rc = IIM42652_reg_write(IIM42652_REG_BANK_0, reg, value);
     if (rc < 0)
     {
         printk("SPI write failed: %d\n", rc);
+#ifdef CONFIG_BT_ZEPHYR_NUS
         bt_nus_printf("SPI write failed: %d\n", rc);
+#endif
+    }
+}
+
+// GYRO_CONFIG0, ACCEL_CONFIG0, GYRO_CONFIG1 and GYRO_ACCEL_CONFIG0 are adjacent, ODR,
+// ranges and filters go out in one burst (GYRO_CONFIG1 keeps its current value)
+static int IIM42652_write_sensor_config(uint8_t odr, uint8_t acc_range, uint8_t gyro_range, uint8_t filters)
+{
+    uint8_t config[4];
+
+    int rc = IIM42652_reg_read(IIM42652_REG_BANK_0, IIM42652_GYRO_CONFIG1, &config[2]);
+    if (rc < 0)
+    {
+        return rc;
+    }
+    config[0] = (gyro_range << IIM42652_FS_SEL_SHIFT) | odr;
+    config[1] = (acc_range << IIM42652_FS_SEL_SHIFT) | odr;
+    config[3] = (filters << 4) | filters;
+    return IIM42652_reg_write_burst(IIM42652_REG_BANK_0, IIM42652_GYRO_CONFIG0, config, sizeof(config));
+}
+
+// OFFSET_USER0..8 hold six 12-bit fields, the upper nibbles of two axes share a byte
+static int IIM42652_write_offsets(const iim42652_offsets_t *offsets)
+{
+    const uint16_t gx = offsets->gyro[0], gy = offsets->gyro[1], gz = offsets->gyro[2];
+    const uint16_t ax = offsets->acc[0], ay = offsets->acc[1], az = offsets->acc[2];
+    const uint8_t regs[] = {
+        gx & 0xFF,
+        ((gy >> 4) & 0xF0) | ((gx >> 8) & 0x0F),
+        gy & 0xFF,
+        gz & 0xFF,
+        ((ax >> 4) & 0xF0) | ((gz >> 8) & 0x0F),
+        ax & 0xFF,
+        ay & 0xFF,
+        ((az >> 4) & 0xF0) | ((ay >> 8) & 0x0F),
+        az & 0xFF,
+    };
+
+    return IIM42652_reg_write_burst(IIM42652_REG_BANK_4, IIM42652_OFFSET_USER0, regs, sizeof(regs));
+}
+
+// Set the SCLK frequency, clamped to the part limit and the devicetree spi-max-frequency
+int IIM42652_set_frequency(uint32_t frequency)
+{
+    if (frequency == 0)
+    {
+        return -EINVAL;
+    }
+    if (iim42652_instance.spi_used)
+    {
+        iim42652_instance.spi[iim42652_instance.spi_idx ^ 1] = iim42652_instance.spi[iim42652_instance.spi_idx];
+        iim42652_instance.spi_idx ^= 1;
+        iim42652_instance.spi_used = false;
+    }
+    iim42652_instance.spi[iim42652_instance.spi_idx].config.frequency =
+        MIN(frequency, iim42652_instance.max_frequency);
+    return 0;
+}
+
+uint32_t IIM42652_get_frequency(void)
+{
+    return iim42652_instance.spi[iim42652_instance.spi_idx].config.frequency;
+}
+
+// Bind the driver to the bus and INT1 line of a devicetree instance instead of the default
+// one, before the part is first used. int_gpio may be NULL or have no port to poll instead.
+int IIM42652_attach(const struct spi_dt_spec *spi, const struct gpio_dt_spec *int_gpio)
+{
+    if (iim42652_instance.initialized)
+    {
+        return -EBUSY;
     }
+
+    iim42652_instance.spi[0] = *spi;
+    iim42652_instance.spi[1] = *spi;
+    iim42652_instance.spi_idx = 0;
+    iim42652_instance.spi_used = false;
+    iim42652_instance.max_frequency = MIN(IIM42652_SPI_MAX_FREQUENCY, spi->config.frequency);
+    iim42652_instance.bank = IIM42652_BANK_UNKNOWN;
+    imu_int1 = int_gpio ? *int_gpio : (struct gpio_dt_spec){0};
+    return 0;
 }
+
 void IIM42652_init(void)
 {
-    if (!device_is_ready(spi1))
+    if (!spi_is_ready_dt(&iim42652_instance.spi[iim42652_instance.spi_idx]))
     {
         iim42652_instance.initialized = false;
         iim42652_instance.data_valid = false;
         return;
     }
 
+    // The part may sit in any bank with any configuration after an MCU reset
+    IIM42652_reg_cache_invalidate();
     uint8_t cfg = IIM42652_read_register(IIM42652_DEVICE_CONFIG);
     if (cfg == 0xFF) // Check if the device is not responding
     {
@@ -99,15 +522,32 @@ void IIM42652_init(void)
     IIM42652_write_register(IIM42652_DEVICE_CONFIG, cfg | 0x01); // Example: Set configuration register to a known state // Example: Set another register to a known state
                                                                  // delay for sensor initialization
     k_sleep(K_MSEC(100));
+    // Soft reset, every register is back to its default and bank 0 is selected
+    IIM42652_reg_cache_invalidate();
+
+    // Restore the last configured ODR, ranges and filters before enabling the sensors
+    IIM42652_write_sensor_config(iim42652_instance.odr, iim42652_instance.acc_range, iim42652_instance.gyro_range,
+                                 iim42652_instance.filters);
+    // Calibration offsets are lost with the reset
+    IIM42652_write_offsets(&iim42652_instance.offsets);
+
+    // 1 us absolute timestamps in the FIFO, readable through TMSTVAL
+    IIM42652_reg_update(IIM42652_REG_BANK_0, IIM42652_TMST_CONFIG,
+                        IIM42652_TMST_TO_REGS_EN | IIM42652_TMST_RES_16US | IIM42652_TMST_DELTA_EN | IIM42652_TMST_EN,
+                        IIM42652_TMST_TO_REGS_EN | IIM42652_TMST_EN);
 
     uint8_t setting = 0x0c | 0x03;                        // LN mode, set gyro and accel to LN mode
     IIM42652_write_register(IIM42652_PWR_MGMT0, setting); // Example: Enable accelerometer
 
     iim42652_instance.initialized = true;
     iim42652_instance.data_valid = false;
+    iim42652_instance.fifo_enabled = false;
+    iim42652_instance.wom_active = false;
+    iim42652_instance.tmst_synced = false;
+    (void)IIM42652_timestamp_sync();
 }
 
-int IIM42652_data(iim42652_data_t *iim_data)
+int IIM42652_data_raw(iim42652_raw_t *raw)
 {
 
     if (!iim42652_instance.initialized)
@@ -119,34 +559,12 @@ int IIM42652_data(iim42652_data_t *iim_data)
         }
         // Return an error code
     }
-    uint8_t rx_data[1 + 2 + 6 + 6] = {0}; // Temp 2 bytes Acc 6 bytes Gyro 6 bytes
-    uint8_t tx_data = IIM42652_TEMP_DATA1_UI | 0x80;
-    // Read accelerometer data from IIM42652
-    struct spi_buf tx_buf = {
-        .buf = &tx_data, // No data to send
-        .len = 1,
-    };
-    struct spi_buf rx_buf = {
-        .buf = rx_data,
-        .len = sizeof(rx_data),
-    };
-    struct spi_buf_set tx = {
-        .buffers = &tx_buf,
-        .count = 1,
-    };
-    struct spi_buf_set rx = {
-        .buffers = &rx_buf,
-        .count = 1,
-    };
-    struct spi_config spi_cfg = {
-        .frequency = 1000000U, // 1 MHz, adjust as needed
-        .operation = SPI_OP_MODE_MASTER | SPI_WORD_SET(8) | SPI_TRANSFER_MSB,
-        .slave = 0,
-        .cs = {
-            .gpio = GPIO_DT_SPEC_GET(SPI1_NODE, cs_gpios),
-        },
-    };
-    int rc = spi_transceive(spi1, &spi_cfg, &tx, &rx);
+    // Prebuilt descriptors bypass the register layer, the bank switch is a no-op normally
+    int rc = IIM42652_select_bank(IIM42652_REG_BANK_0);
+    if (rc == 0)
+    {
+        rc = spi_transceive_dt(IIM42652_spi(), &data_tx, &data_rx_set);
+    }
     if (rc < 0)
     {
         iim42652_instance.initialized = false;
@@ -157,24 +575,1243 @@ int IIM42652_data(iim42652_data_t *iim_data)
     // assuming the data is in the format:
     // [Temp MSB, Temp LSB, Accel X MSB, Accel X LSB, Accel Y MSB, Accel Y LSB, Accel Z MSB, Accel Z LSB,
     // Gyro X MSB, Gyro X LSB, Gyro Y MSB, Gyro Y LSB, Gyro Z MSB, Gyro Z LSB]
-    uint8_t temp_msb = rx_data[1];
-    uint8_t temp_lsb = rx_data[2];
-    uint8_t *accel_data = rx_data + 1 + 2;    // Skip the first byte (command byte)
-    uint8_t *gyro_data = rx_data + 1 + 2 + 6; // Skip the first byte (command byte) and temperature bytes
+    const uint8_t *accel_data = data_rx + 2;
+    const uint8_t *gyro_data = data_rx + 2 + 6;
+
+    raw->temp = (int16_t)((data_rx[0] << 8) | data_rx[1]);
+    for (int axis = 0; axis < 3; axis++)
+    {
+        raw->acc[axis] = (int16_t)((accel_data[2 * axis] << 8) | accel_data[2 * axis + 1]);
+        raw->gyro[axis] = (int16_t)((gyro_data[2 * axis] << 8) | gyro_data[2 * axis + 1]);
+    }
+
+    return 0;
+}
+
+int IIM42652_data(iim42652_data_t *iim_data)
+{
+    iim42652_raw_t raw;
+
+    int rc = IIM42652_data_raw(&raw);
+    if (rc < 0)
+    {
+        return rc;
+    }
+    IIM42652_convert(&raw, iim_data, 1);
+    return 0;
+}
+
+// Configure stream-to-FIFO mode with accel, gyro, temperature and timestamp
+// (16-byte packet 3). The watermark is given in packets.
+int IIM42652_fifo_enable(uint16_t watermark)
+{
+    if (!iim42652_instance.initialized)
+    {
+        IIM42652_init();
+        if (!iim42652_instance.initialized)
+        {
+            return -ENODEV;
+        }
+    }
+    if (watermark == 0 || watermark > IIM42652_FIFO_SIZE / IIM42652_fifo_packet_size())
+    {
+        return -EINVAL;
+    }
+    if (!IIM42652_fifo_odr_valid(iim42652_instance.odr))
+    {
+        return -EINVAL;
+    }
+
+    // Count FIFO content and watermark in records instead of bytes
+    IIM42652_reg_update(IIM42652_REG_BANK_0, IIM42652_INTF_CONFIG0, IIM42652_FIFO_COUNT_REC, IIM42652_FIFO_COUNT_REC);
+
+    // FIFO_CONFIG1..3 are adjacent, packet content and watermark in one burst
+    const uint8_t fifo_config[] = {
+        IIM42652_FIFO_WM_GT_TH | (iim42652_instance.fifo_hires ? IIM42652_FIFO_HIRES_EN : 0) |
+            IIM42652_FIFO_TMST_FSYNC_EN | IIM42652_FIFO_TEMP_EN | IIM42652_FIFO_GYRO_EN | IIM42652_FIFO_ACCEL_EN,
+        watermark & 0xFF,
+        (watermark >> 8) & 0x0F,
+    };
+    IIM42652_reg_write_burst(IIM42652_REG_BANK_0, IIM42652_FIFO_CONFIG1, fifo_config, sizeof(fifo_config));
+    IIM42652_write_register(IIM42652_FIFO_CONFIG, IIM42652_STREAM_TO_FIFO << IIM42652_FIFO_MODE_SHIFT);
 
-    // Convert temperature using formula: (TEMP_DATA / 132.48) + 25
-    int16_t temp_raw = (int16_t)((temp_msb << 8) | temp_lsb);
-    iim_data->temp = ((double)temp_raw / 132.48) + 25.0; // Correct temperature conversion
+    iim42652_instance.fifo_enabled = true;
+    return IIM42652_fifo_flush();
+}
 
-    // Process accelerometer data
-    iim_data->acc[0] = (double)((int16_t)((accel_data[0] << 8) | accel_data[1])) / 2048.0; // Convert to g
-    iim_data->acc[1] = (double)((int16_t)((accel_data[2] << 8) | accel_data[3])) / 2048.0; // Convert to g
-    iim_data->acc[2] = (double)((int16_t)((accel_data[4] << 8) | accel_data[5])) / 2048.0; // Convert to g
+// Switch between 16-byte packet 3 and 20-byte high resolution packet 4. In high resolution
+// mode accel and gyro run at fixed +-16 g / +-2000 dps whatever FS_SEL says, with 18/19
+// significant bits. Queued packets are dropped when the FIFO is running.
+int IIM42652_fifo_set_hires(bool enable)
+{
+    iim42652_instance.fifo_hires = enable;
+    if (!iim42652_instance.fifo_enabled)
+    {
+        return 0;
+    }
+    int rc = IIM42652_reg_update(IIM42652_REG_BANK_0, IIM42652_FIFO_CONFIG1, IIM42652_FIFO_HIRES_EN,
+                                 enable ? IIM42652_FIFO_HIRES_EN : 0);
+    if (rc < 0)
+    {
+        return rc;
+    }
+    return IIM42652_fifo_flush();
+}
 
-    // Process gyroscope data
-    iim_data->gyro[0] = (double)((int16_t)((gyro_data[0] << 8) | gyro_data[1])) / 16.4; // Convert to dps
-    iim_data->gyro[1] = (double)((int16_t)((gyro_data[2] << 8) | gyro_data[3])) / 16.4; // Convert to dps
-    iim_data->gyro[2] = (double)((int16_t)((gyro_data[4] << 8) | gyro_data[5])) / 16.4; // Convert to dps
+size_t IIM42652_fifo_packet_size(void)
+{
+    return iim42652_instance.fifo_hires ? IIM42652_FIFO_PACKET_SIZE_HIRES : IIM42652_FIFO_PACKET_SIZE;
+}
 
+int IIM42652_fifo_disable(void)
+{
+    if (!iim42652_instance.initialized)
+    {
+        return -ENODEV;
+    }
+    IIM42652_write_register(IIM42652_FIFO_CONFIG, IIM42652_FIFO_BYPASS << IIM42652_FIFO_MODE_SHIFT);
+    iim42652_instance.fifo_enabled = false;
     return 0;
-}
\ No newline at end of file
+}
+
+// Drop FIFO content and restart the timestamp unwrapping from a fresh time base sync,
+// every packet queued afterwards is newer than the strobe. Also clears the lost packet counter.
+int IIM42652_fifo_flush(void)
+{
+    if (!iim42652_instance.initialized)
+    {
+        return -ENODEV;
+    }
+    int rc = IIM42652_reg_write(IIM42652_REG_BANK_0, IIM42652_SIGNAL_PATH_RESET, IIM42652_FIFO_FLUSH);
+    if (rc < 0)
+    {
+        return rc;
+    }
+    rc = IIM42652_timestamp_sync();
+    iim42652_instance.fifo_timestamp = iim42652_instance.tmst_sensor_us;
+    iim42652_instance.fifo_last_timestamp = iim42652_instance.tmst_sensor_us & IIM42652_FIFO_TMST_MASK;
+    return rc;
+}
+
+// After a failed FIFO transfer the selected bank, the shadow and the FIFO read position
+// are unknown: drop the register cache and restart the FIFO empty, so the next drain does
+// not work from stale state. If the bus still fails the part is re-initialized on next use.
+// Call it only once the failed transfer has completed.
+int IIM42652_fifo_recover(void)
+{
+    IIM42652_reg_cache_invalidate();
+    if (!iim42652_instance.initialized)
+    {
+        return -ENODEV;
+    }
+    if (!iim42652_instance.fifo_enabled)
+    {
+        return 0;
+    }
+
+    int rc = IIM42652_fifo_flush();
+    if (rc < 0)
+    {
+        iim42652_instance.initialized = false;
+        iim42652_instance.fifo_enabled = false;
+    }
+    return rc;
+}
+
+// Number of packets currently stored in the FIFO
+int IIM42652_fifo_count(uint16_t *count)
+{
+    uint8_t raw[2];
+
+    if (!iim42652_instance.fifo_enabled)
+    {
+        return -EACCES;
+    }
+    int rc = IIM42652_read_burst(IIM42652_FIFO_COUNTH, raw, sizeof(raw));
+    if (rc < 0)
+    {
+        return rc;
+    }
+    *count = ((uint16_t)raw[0] << 8) | raw[1]; // FIFO_COUNT is big endian by default
+    return 0;
+}
+
+// Drain up to max_samples packets from the FIFO in one SPI transaction.
+// Returns the number of samples stored or a negative error code.
+int IIM42652_fifo_read(iim42652_fifo_sample_t *samples, size_t max_samples)
+{
+    uint16_t count;
+    int rc = IIM42652_fifo_count(&count);
+    if (rc < 0)
+    {
+        return rc;
+    }
+
+    const size_t packet_size = IIM42652_fifo_packet_size();
+    size_t packets = MIN(MIN((size_t)count, max_samples), IIM42652_FIFO_SIZE / packet_size);
+    if (packets == 0)
+    {
+        return 0;
+    }
+
+    fifo_rx_bufs[1].buf = fifo_buffer;
+    fifo_rx_bufs[1].len = packets * packet_size;
+    rc = spi_transceive_dt(IIM42652_spi(), &fifo_tx, &fifo_rx_set);
+    if (rc < 0)
+    {
+        IIM42652_fifo_recover();
+        return rc;
+    }
+
+    return IIM42652_fifo_parse(fifo_buffer, packets, samples);
+}
+
+// Start draining up to max_packets FIFO packets into buffer without blocking, the
+// transfer completes through signal (SPIM EasyDMA runs while the caller keeps working).
+// buffer must hold max_packets * IIM42652_fifo_packet_size() bytes (IIM42652_FIFO_SIZE always
+// does, the count is capped to the FIFO content) and stay untouched until
+// the signal is raised, then hand it to IIM42652_fifo_parse. Only one drain may be in flight.
+// Returns the number of packets being transferred, 0 when the FIFO is empty (no signal).
+int IIM42652_fifo_read_async(uint8_t *buffer, size_t max_packets, struct k_poll_signal *signal)
+{
+#ifdef CONFIG_SPI_ASYNC
+    uint16_t count;
+    int rc = IIM42652_fifo_count(&count);
+    if (rc < 0)
+    {
+        return rc;
+    }
+
+    const size_t packet_size = IIM42652_fifo_packet_size();
+    size_t packets = MIN(MIN((size_t)count, max_packets), IIM42652_FIFO_SIZE / packet_size);
+    if (packets == 0)
+    {
+        return 0;
+    }
+
+    fifo_rx_bufs[1].buf = buffer;
+    fifo_rx_bufs[1].len = packets * packet_size;
+    const struct spi_dt_spec *spi = IIM42652_spi();
+    k_poll_signal_reset(signal);
+    if (IIM42652_SPI_ASYNC)
+    {
+        rc = spi_transceive_signal(spi->bus, &spi->config, &fifo_tx, &fifo_rx_set, signal);
+    }
+    else
+    {
+        rc = spi_transceive_dt(spi, &fifo_tx, &fifo_rx_set);
+        if (rc == 0)
+        {
+            k_poll_signal_raise(signal, 0);
+        }
+    }
+    if (rc < 0)
+    {
+        IIM42652_fifo_recover();
+        return rc;
+    }
+    return packets;
+#else
+    ARG_UNUSED(buffer);
+    ARG_UNUSED(max_packets);
+    ARG_UNUSED(signal);
+    return -ENOTSUP;
+#endif
+}
+
+// Same as IIM42652_fifo_read_async for a packet count the caller already knows
+// (from IIM42652_fifo_count), completion is reported through cb.
+int IIM42652_fifo_read_cb(uint8_t *buffer, size_t packets, spi_callback_t cb, void *user_data)
+{
+#ifdef CONFIG_SPI_ASYNC
+    if (packets == 0 || packets > IIM42652_FIFO_SIZE / IIM42652_fifo_packet_size())
+    {
+        return -EINVAL;
+    }
+
+    int rc = IIM42652_select_bank(IIM42652_REG_BANK_0);
+    if (rc < 0)
+    {
+        return rc;
+    }
+
+    fifo_rx_bufs[1].buf = buffer;
+    fifo_rx_bufs[1].len = packets * IIM42652_fifo_packet_size();
+    const struct spi_dt_spec *spi = IIM42652_spi();
+    if (IIM42652_SPI_ASYNC)
+    {
+        rc = spi_transceive_cb(spi->bus, &spi->config, &fifo_tx, &fifo_rx_set, cb, user_data);
+    }
+    else
+    {
+        rc = spi_transceive_dt(spi, &fifo_tx, &fifo_rx_set);
+        if (rc == 0)
+        {
+            cb(spi->bus, 0, user_data);
+        }
+    }
+    if (rc < 0)
+    {
+        IIM42652_fifo_recover();
+        return rc;
+    }
+    return packets;
+#else
+    ARG_UNUSED(buffer);
+    ARG_UNUSED(packets);
+    ARG_UNUSED(cb);
+    ARG_UNUSED(user_data);
+    return -ENOTSUP;
+#endif
+}
+
+// Latch the 20-bit sensor time into TMSTVAL and read it back from bank 1. The strobe
+// lands at the end of the write, uptime is taken halfway between the tick reads around it.
+static int IIM42652_read_tmst(uint32_t *tmst, uint64_t *uptime_ns)
+{
+    uint8_t raw[3];
+
+    int64_t before = k_uptime_ticks();
+    IIM42652_write_register(IIM42652_SIGNAL_PATH_RESET, IIM42652_TMST_STROBE);
+    int64_t after = k_uptime_ticks();
+
+    int rc = IIM42652_reg_read_burst(IIM42652_REG_BANK_1, IIM42652_TMSTVAL0, raw, sizeof(raw));
+    if (rc < 0)
+    {
+        return rc;
+    }
+
+    *tmst = (((uint32_t)raw[2] << 16) | ((uint32_t)raw[1] << 8) | raw[0]) & IIM42652_TMST_MASK;
+    *uptime_ns = k_ticks_to_ns_floor64(before + after) / 2;
+    return 0;
+}
+
+// Map sensor time to uptime through the anchor, corrected by the drift estimate
+uint64_t IIM42652_timestamp_to_uptime(uint64_t sensor_us)
+{
+    int64_t delta_us = (int64_t)(sensor_us - iim42652_instance.tmst_sensor_us);
+    int64_t delta_ns = delta_us * NSEC_PER_USEC + delta_us * iim42652_instance.tmst_drift_ppb / 1000000;
+
+    return iim42652_instance.tmst_uptime_ns + delta_ns;
+}
+
+static uint64_t IIM42652_sample_time(uint64_t sensor_us)
+{
+    uint64_t uptime_ns = IIM42652_timestamp_to_uptime(sensor_us);
+
+    // Anchor corrections must not reorder samples across a sync
+    if (uptime_ns <= iim42652_instance.last_sample_ns)
+    {
+        uptime_ns = iim42652_instance.last_sample_ns + 1;
+    }
+    iim42652_instance.last_sample_ns = uptime_ns;
+    return uptime_ns;
+}
+
+// Correlate the sensor time base with k_uptime_ticks. Call it about once per second while
+// sampling: it unwraps the 20-bit counter (using the elapsed uptime for gaps over a second)
+// and slews anchor and drift towards the measurement, so tick quantization and bus latency
+// are averaged out instead of showing up as jumps in the sample times.
+int IIM42652_timestamp_sync(void)
+{
+    uint32_t tmst;
+    uint64_t now_ns;
+
+    if (!iim42652_instance.initialized)
+    {
+        return -ENODEV;
+    }
+    int rc = IIM42652_read_tmst(&tmst, &now_ns);
+    if (rc < 0)
+    {
+        return rc;
+    }
+
+    if (!iim42652_instance.tmst_synced)
+    {
+        iim42652_instance.tmst_raw = tmst;
+        iim42652_instance.tmst_sensor_us = tmst;
+        iim42652_instance.tmst_uptime_ns = now_ns;
+        iim42652_instance.tmst_synced = true;
+        return 0;
+    }
+
+    const uint64_t period = (uint64_t)IIM42652_TMST_MASK + 1;
+    uint64_t elapsed_us = (now_ns - iim42652_instance.tmst_uptime_ns) / NSEC_PER_USEC;
+    uint64_t delta_us = (tmst - iim42652_instance.tmst_raw) & IIM42652_TMST_MASK;
+    if (elapsed_us > delta_us)
+    {
+        delta_us += (elapsed_us - delta_us + period / 2) / period * period;
+    }
+    uint64_t sensor_us = iim42652_instance.tmst_sensor_us + delta_us;
+
+    int64_t predicted_ns = IIM42652_timestamp_to_uptime(sensor_us);
+    int64_t error_ns = (int64_t)now_ns - predicted_ns;
+    iim42652_instance.tmst_raw = tmst;
+    iim42652_instance.tmst_sensor_us = sensor_us;
+
+    if (error_ns > IIM42652_TMST_RESYNC_NS || error_ns < -IIM42652_TMST_RESYNC_NS)
+    {
+        iim42652_instance.tmst_uptime_ns = now_ns;
+        return 0;
+    }
+
+    if (delta_us > 0)
+    {
+        int64_t drift = iim42652_instance.tmst_drift_ppb +
+                        error_ns * 1000000 / (int64_t)delta_us / IIM42652_TMST_DRIFT_GAIN;
+        iim42652_instance.tmst_drift_ppb = CLAMP(drift, -IIM42652_TMST_DRIFT_MAX, IIM42652_TMST_DRIFT_MAX);
+    }
+    iim42652_instance.tmst_uptime_ns = predicted_ns + error_ns / IIM42652_TMST_PHASE_GAIN;
+    return 0;
+}
+
+int32_t IIM42652_timestamp_drift(void)
+{
+    return iim42652_instance.tmst_drift_ppb;
+}
+
+// Six big endian int16 (three axes of accel and/or gyro) starting at p. On Cortex-M the
+// bytes are loaded a word at a time (unaligned loads are fine) and REV16 swaps both
+// halfwords in one instruction, the sign extension folds into SXTH.
+static inline void IIM42652_unpack_be16x6(const uint8_t *p, int32_t out[6])
+{
+#ifdef CONFIG_CPU_CORTEX_M
+    uint32_t words[3];
+
+    memcpy(words, p, sizeof(words));
+    for (int i = 0; i < 3; i++)
+    {
+        uint32_t w = __REV16(words[i]);
+        out[2 * i] = (int16_t)w;
+        out[2 * i + 1] = (int16_t)(w >> 16);
+    }
+#else
+    for (int i = 0; i < 6; i++)
+    {
+        out[i] = (int16_t)sys_get_be16(&p[2 * i]);
+    }
+#endif
+}
+
+static inline size_t IIM42652_packet_decode(const uint8_t *pkt, int32_t acc[3], int32_t gyro[3], int16_t *temp,
+                                            uint16_t *timestamp)
+{
+    const uint8_t header = pkt[0];
+    const bool has_acc = header & IIM42652_FIFO_HEADER_ACCEL;
+    const bool has_gyro = header & IIM42652_FIFO_HEADER_GYRO;
+    int32_t values[6];
+
+    if ((header & IIM42652_FIFO_HEADER_MSG) || (!has_acc && !has_gyro))
+    {
+        return 0;
+    }
+
+    if (header & IIM42652_FIFO_HEADER_20)
+    {
+        // Packet 4, bits [19:4] in the usual places, bits [3:0] in the trailing bytes
+        // (accel in the high nibble, gyro in the low one)
+        if (!has_acc || !has_gyro)
+        {
+            return 0;
+        }
+        IIM42652_unpack_be16x6(&pkt[1], values);
+        for (int axis = 0; axis < 3; axis++)
+        {
+            acc[axis] = values[axis] * 16 | (pkt[17 + axis] >> 4);
+            gyro[axis] = values[3 + axis] * 16 | (pkt[17 + axis] & 0x0F);
+        }
+        *temp = (int16_t)sys_get_be16(&pkt[13]);
+        *timestamp = sys_get_be16(&pkt[15]);
+        return IIM42652_FIFO_PACKET_SIZE_HIRES;
+    }
+
+    if (has_acc && has_gyro)
+    {
+        // Packet 3
+        IIM42652_unpack_be16x6(&pkt[1], values);
+        for (int axis = 0; axis < 3; axis++)
+        {
+            acc[axis] = values[axis];
+            gyro[axis] = values[3 + axis];
+        }
+        // FIFO temperature has 2.07 LSB/C, rescale to the 132.48 LSB/C of TEMP_DATA
+        *temp = (int16_t)((int8_t)pkt[13]) * 64;
+        *timestamp = sys_get_be16(&pkt[14]);
+        return IIM42652_FIFO_PACKET_SIZE;
+    }
+
+    // Packet 1 (accel only) or 2 (gyro only), no timestamp field
+    int32_t *present = has_acc ? acc : gyro;
+    int32_t *missing = has_acc ? gyro : acc;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        present[axis] = (int16_t)sys_get_be16(&pkt[1 + 2 * axis]);
+        missing[axis] = 0;
+    }
+    *temp = (int16_t)((int8_t)pkt[7]) * 64;
+    *timestamp = 0;
+    return IIM42652_FIFO_PACKET_SIZE_SINGLE;
+}
+
+// Decode one FIFO packet of any format, selected by its header byte. Values are returned
+// as delivered: 16 bits for packets 1-3, 20 bits for packet 4. A sensor missing from the
+// packet reads 0, temp is in TEMP_DATA units and timestamp is 0 for packets 1/2.
+// Returns the packet size, 0 for an empty FIFO or an invalid header.
+size_t IIM42652_fifo_packet_decode(const uint8_t *pkt, int32_t acc[3], int32_t gyro[3], int16_t *temp,
+                                   uint16_t *timestamp)
+{
+    return IIM42652_packet_decode(pkt, acc, gyro, temp, timestamp);
+}
+
+// Sample time of the next packet. Timestamp holds the 16 LSBs of the 1 us sensor time,
+// unwrap it from the value seeded at the last flush. Valid as long as consecutive samples
+// are less than 65 ms apart, which IIM42652_fifo_enable and IIM42652_configure enforce
+// through IIM42652_FIFO_ODR_MIN_HZ. Packets 1/2 advance by one ODR period.
+static uint64_t IIM42652_fifo_time(size_t packet_size, uint16_t ts)
+{
+    __ASSERT(IIM42652_fifo_odr_valid(iim42652_instance.odr), "ODR too low for the FIFO timestamps");
+
+    if (packet_size == IIM42652_FIFO_PACKET_SIZE_SINGLE)
+    {
+        iim42652_instance.fifo_timestamp += (uint32_t)(1000000.0f / odr_hz[iim42652_instance.odr]);
+        ts = iim42652_instance.fifo_timestamp & IIM42652_FIFO_TMST_MASK;
+    }
+    else
+    {
+        iim42652_instance.fifo_timestamp += (uint16_t)(ts - iim42652_instance.fifo_last_timestamp);
+    }
+    iim42652_instance.fifo_last_timestamp = ts;
+    return IIM42652_sample_time(iim42652_instance.fifo_timestamp);
+}
+
+static inline int16_t IIM42652_saturate16(int32_t value)
+{
+    return (int16_t)CLAMP(value, INT16_MIN, INT16_MAX);
+}
+
+// Decode raw FIFO packets in drain order. Returns the number of samples stored,
+// parsing stops at the first empty or incomplete packet. High resolution packets are
+// rescaled to the configured ranges (saturating) so raw keeps its usual meaning.
+int IIM42652_fifo_parse(const uint8_t *buffer, size_t packets, iim42652_fifo_sample_t *samples)
+{
+    const size_t len = packets * IIM42652_fifo_packet_size();
+    const uint8_t acc_range = iim42652_instance.acc_range;
+    const uint8_t gyro_range = iim42652_instance.gyro_range;
+    size_t offset = 0;
+    size_t n = 0;
+
+    while (n < packets && offset < len)
+    {
+        int32_t acc[3], gyro[3];
+        int16_t temp;
+        uint16_t ts;
+
+        size_t size = IIM42652_packet_decode(&buffer[offset], acc, gyro, &temp, &ts);
+        if (size == 0 || offset + size > len)
+        {
+            break;
+        }
+        offset += size;
+
+        iim42652_fifo_sample_t *s = &samples[n++];
+        for (int axis = 0; axis < 3; axis++)
+        {
+            if (size == IIM42652_FIFO_PACKET_SIZE_HIRES)
+            {
+                // 8192 LSB/g = 2048 << 2, 131 LSB/dps = 16.4 << 3
+                s->raw.acc[axis] = IIM42652_saturate16((acc[axis] * (1 << acc_range)) >> 2);
+                s->raw.gyro[axis] = IIM42652_saturate16((gyro[axis] * (1 << gyro_range)) >> 3);
+            }
+            else
+            {
+                s->raw.acc[axis] = acc[axis];
+                s->raw.gyro[axis] = gyro[axis];
+            }
+        }
+        s->raw.temp = temp;
+        s->timestamp = IIM42652_fifo_time(size, ts);
+    }
+
+    return n;
+}
+
+// Unpack a drained batch into structure-of-arrays form, keeping the full 20-bit resolution
+// of packet 4. Returns the number of samples stored. A batch holds a single packet format,
+// the scales of the batch are the ones of its last packet.
+int IIM42652_fifo_unpack(const uint8_t *buffer, size_t packets, iim42652_fifo_batch_t *batch)
+{
+    const size_t len = packets * IIM42652_fifo_packet_size();
+    size_t offset = 0;
+    size_t n = 0;
+    size_t format = 0;
+
+    while (n < IIM42652_FIFO_SOA_CAPACITY && offset < len)
+    {
+        int32_t acc[3], gyro[3];
+        uint16_t ts;
+
+        size_t size = IIM42652_packet_decode(&buffer[offset], acc, gyro, &batch->temp[n], &ts);
+        if (size == 0 || offset + size > len)
+        {
+            break;
+        }
+        offset += size;
+        format = size;
+
+        batch->acc[0][n] = acc[0];
+        batch->acc[1][n] = acc[1];
+        batch->acc[2][n] = acc[2];
+        batch->gyro[0][n] = gyro[0];
+        batch->gyro[1][n] = gyro[1];
+        batch->gyro[2][n] = gyro[2];
+        batch->timestamp[n] = IIM42652_fifo_time(size, ts);
+        n++;
+    }
+
+    if (format == IIM42652_FIFO_PACKET_SIZE_HIRES)
+    {
+        batch->acc_scale = 1.0f / IIM42652_HIRES_ACC_LSB_PER_G;
+        batch->gyro_scale = 1.0f / IIM42652_HIRES_GYRO_LSB_PER_DPS;
+    }
+    else
+    {
+        batch->acc_scale = iim42652_instance.acc_scale;
+        batch->gyro_scale = iim42652_instance.gyro_scale;
+    }
+    batch->count = n;
+    return n;
+}
+
+// Number of packets dropped because the FIFO overflowed since the last flush
+int IIM42652_fifo_lost_packets(uint16_t *lost)
+{
+    uint8_t raw[2];
+
+    if (!iim42652_instance.initialized)
+    {
+        return -ENODEV;
+    }
+    int rc = IIM42652_read_burst(IIM42652_FIFO_LOST_PKT0, raw, sizeof(raw));
+    if (rc < 0)
+    {
+        return rc;
+    }
+    *lost = ((uint16_t)raw[1] << 8) | raw[0];
+    return 0;
+}
+
+// Batch conversion of raw samples to physical units. Scales are single precision so the
+// loop stays on the FPU, call it on whole batches rather than per sample.
+void IIM42652_convert(const iim42652_raw_t *raw, iim42652_data_t *iim_data, size_t count)
+{
+    const float acc_scale = iim42652_instance.acc_scale;
+    const float gyro_scale = iim42652_instance.gyro_scale;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        for (int axis = 0; axis < 3; axis++)
+        {
+            iim_data[i].acc[axis] = (float)raw[i].acc[axis] * acc_scale;    // Convert to g
+            iim_data[i].gyro[axis] = (float)raw[i].gyro[axis] * gyro_scale; // Convert to dps
+        }
+        iim_data[i].temp = (float)raw[i].temp * IIM42652_TEMP_SCALE + IIM42652_TEMP_OFFSET;
+    }
+}
+
+// Q15 conversion, full scale of the configured range maps to +-1.0. The raw
+// 16-bit samples already are Q15 fractions of full scale, only the temperature
+// is moved into the same unit (1/128 C) as the FIFO temperature.
+void IIM42652_convert_q15(const iim42652_raw_t *raw, iim42652_q15_t *q15, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        for (int axis = 0; axis < 3; axis++)
+        {
+            q15[i].acc[axis] = raw[i].acc[axis];
+            q15[i].gyro[axis] = raw[i].gyro[axis];
+        }
+        // 132.48 LSB/C to 128 LSB/C, (x * 31660) >> 15 = x * 0.9662
+        q15[i].temp = (int16_t)(((int32_t)raw[i].temp * 31660) >> 15);
+    }
+}
+
+static void IIM42652_int1_handler(const struct device *port, struct gpio_callback *cb, gpio_port_pins_t pins)
+{
+    ARG_UNUSED(port);
+    ARG_UNUSED(cb);
+    ARG_UNUSED(pins);
+
+    if (imu_event_handler)
+    {
+        imu_event_handler();
+        return;
+    }
+    k_sem_give(&imu_int1_sem);
+}
+
+// Deliver INT1 to handler (ISR context) instead of IIM42652_wait_event, NULL restores the default
+void IIM42652_set_event_handler(iim42652_event_handler_t handler)
+{
+    imu_event_handler = handler;
+}
+
+// True when an INT1 event is waiting for IIM42652_wait_event
+bool IIM42652_event_pending(void)
+{
+    return k_sem_count_get(&imu_int1_sem) > 0;
+}
+
+int IIM42652_int_status(uint8_t *status)
+{
+    return IIM42652_read_burst(IIM42652_INT_STATUS, status, 1);
+}
+
+static int IIM42652_int1_check(void)
+{
+    if (imu_int1.port == NULL)
+    {
+        return -ENOTSUP;
+    }
+    if (!gpio_is_ready_dt(&imu_int1))
+    {
+        return -ENODEV;
+    }
+    if (!iim42652_instance.initialized)
+    {
+        IIM42652_init();
+        if (!iim42652_instance.initialized)
+        {
+            return -ENODEV;
+        }
+    }
+    return 0;
+}
+
+// INT1 as a push-pull, active high pulse and the GPIO interrupt armed on it.
+// The caller routes the sources (INT_SOURCE0/INT_SOURCE1) beforehand.
+static int IIM42652_int1_arm(void)
+{
+    static bool callback_added;
+
+    IIM42652_write_register(IIM42652_INT_CONFIG, IIM42652_INT1_DRIVE_PUSH_PULL | IIM42652_INT1_POLARITY_HIGH);
+    // INT_ASYNC_RESET has to be cleared for proper INT1/INT2 operation
+    IIM42652_reg_update(IIM42652_REG_BANK_0, IIM42652_INT_CONFIG1, IIM42652_INT_ASYNC_RESET, 0);
+
+    int rc = gpio_pin_configure_dt(&imu_int1, GPIO_INPUT);
+    if (rc < 0)
+    {
+        return rc;
+    }
+    if (!callback_added)
+    {
+        gpio_init_callback(&imu_int1_cb, IIM42652_int1_handler, BIT(imu_int1.pin));
+        rc = gpio_add_callback(imu_int1.port, &imu_int1_cb);
+        if (rc < 0)
+        {
+            return rc;
+        }
+        callback_added = true;
+    }
+
+    k_sem_reset(&imu_int1_sem);
+    // Clear any event latched before the interrupt got armed
+    (void)IIM42652_read_register(IIM42652_INT_STATUS);
+    (void)IIM42652_read_register(IIM42652_INT_STATUS2);
+    return gpio_pin_interrupt_configure_dt(&imu_int1, GPIO_INT_EDGE_TO_ACTIVE);
+}
+
+// Route the given events (IIM42652_INT_DATA_READY, IIM42652_INT_FIFO_THS, IIM42652_INT_FIFO_FULL)
+// to INT1 and arm the GPIO interrupt.
+int IIM42652_int_enable(uint8_t events)
+{
+    int rc = IIM42652_int1_check();
+    if (rc < 0)
+    {
+        return rc;
+    }
+
+    IIM42652_write_register(IIM42652_INT_SOURCE0,
+                            events & (IIM42652_INT_DATA_READY | IIM42652_INT_FIFO_THS | IIM42652_INT_FIFO_FULL));
+    return IIM42652_int1_arm();
+}
+
+int IIM42652_int_disable(void)
+{
+    if (imu_int1.port == NULL)
+    {
+        return -ENOTSUP;
+    }
+    if (iim42652_instance.initialized)
+    {
+        IIM42652_write_register(IIM42652_INT_SOURCE0, 0);
+        IIM42652_write_register(IIM42652_INT_SOURCE1, 0);
+    }
+    return gpio_pin_interrupt_configure_dt(&imu_int1, GPIO_INT_DISABLE);
+}
+
+// Block until INT1 fires or the timeout expires. On success status holds INT_STATUS, or
+// INT_STATUS2 (IIM42652_INT_WOM_*, IIM42652_INT_SMD) while wake-on-motion is armed.
+// Reading it also acknowledges the event on the sensor side.
+int IIM42652_wait_event(k_timeout_t timeout, uint8_t *status)
+{
+    int rc = k_sem_take(&imu_int1_sem, timeout);
+    if (rc < 0)
+    {
+        return rc;
+    }
+    uint8_t int_status = IIM42652_read_register(iim42652_instance.wom_active ? IIM42652_INT_STATUS2
+                                                                              : IIM42652_INT_STATUS);
+    if (status)
+    {
+        *status = int_status;
+    }
+    return 0;
+}
+
+// Wake-on-motion: gyro off, FIFO and data interrupts off, accel in low power mode at 50 Hz
+// on the wake-up oscillator, each sample compared with the previous one. threshold_mg is
+// the change on any axis that raises IIM42652_INT_WOM_* on INT1 (3.9 mg resolution).
+// With IIM42652_SMD_MODE_SHORT/LONG the APEX significant motion detector additionally
+// raises IIM42652_INT_SMD for sustained motion. Sequence and delays follow the datasheet.
+int IIM42652_wom_enable(uint16_t threshold_mg, uint8_t mode)
+{
+    if (mode == IIM42652_SMD_MODE_DISABLED || mode > IIM42652_SMD_MODE_LONG)
+    {
+        return -EINVAL;
+    }
+    int rc = IIM42652_int1_check();
+    if (rc < 0)
+    {
+        return rc;
+    }
+
+    uint32_t threshold = ((uint32_t)threshold_mg * 1000U) / IIM42652_WOM_THR_UG_PER_LSB;
+    threshold = CLAMP(threshold, 1U, 255U);
+
+    IIM42652_write_register(IIM42652_INT_SOURCE0, 0);
+    if (iim42652_instance.fifo_enabled)
+    {
+        IIM42652_fifo_disable();
+    }
+
+    IIM42652_write_register(IIM42652_ACCEL_CONFIG0,
+                            (iim42652_instance.acc_range << IIM42652_FS_SEL_SHIFT) | IIM42652_ODR_50HZ);
+    IIM42652_reg_update(IIM42652_REG_BANK_0, IIM42652_INTF_CONFIG1, IIM42652_ACCEL_LP_CLK_SEL, 0);
+    IIM42652_write_register(IIM42652_APEX_CONFIG0, IIM42652_DMP_POWER_SAVE | IIM42652_DMP_ODR_50HZ);
+    IIM42652_write_register(IIM42652_PWR_MGMT0, IIM42652_ACCEL_MODE_LP);
+    k_sleep(K_MSEC(1));
+
+    const uint8_t thresholds[] = {threshold, threshold, threshold};
+    IIM42652_reg_write_burst(IIM42652_REG_BANK_4, IIM42652_ACCEL_WOM_X_THR, thresholds, sizeof(thresholds));
+    k_sleep(K_MSEC(1));
+
+    uint8_t sources = IIM42652_INT_WOM;
+    if (mode != IIM42652_SMD_MODE_WOM)
+    {
+        sources |= IIM42652_INT_SMD;
+    }
+    IIM42652_write_register(IIM42652_INT_SOURCE1, sources);
+    k_sleep(K_MSEC(50));
+    IIM42652_write_register(IIM42652_SMD_CONFIG, IIM42652_WOM_MODE_PREV | mode);
+
+    iim42652_instance.wom_active = true;
+    return IIM42652_int1_arm();
+}
+
+// Leave wake-on-motion and restore low noise mode with the configured ODR and ranges.
+// FIFO and interrupts stay off, re-enable them afterwards.
+int IIM42652_wom_disable(void)
+{
+    if (!iim42652_instance.initialized)
+    {
+        return -ENODEV;
+    }
+    if (!iim42652_instance.wom_active)
+    {
+        return 0;
+    }
+
+    IIM42652_write_register(IIM42652_SMD_CONFIG, IIM42652_SMD_MODE_DISABLED);
+    IIM42652_write_register(IIM42652_INT_SOURCE1, 0);
+    IIM42652_write_sensor_config(iim42652_instance.odr, iim42652_instance.acc_range, iim42652_instance.gyro_range,
+                                 iim42652_instance.filters);
+    IIM42652_write_register(IIM42652_PWR_MGMT0, IIM42652_GYRO_MODE_LN | IIM42652_ACCEL_MODE_LN);
+    // Gyro needs 45 ms after power up before its output is valid
+    k_sleep(K_MSEC(45));
+
+    iim42652_instance.wom_active = false;
+    return 0;
+}
+
+bool IIM42652_wom_active(void)
+{
+    return iim42652_instance.wom_active;
+}
+
+// Set output data rate, full-scale ranges and UI filter bandwidth at runtime.
+// odr is one of IIM42652_ODR_* (the accel-only rates below 12.5 Hz are rejected, and
+// with the FIFO running anything below IIM42652_FIFO_ODR_MIN_HZ), ranges are
+// IIM42652_RANGE_*, filters is one of IIM42652_UI_FILT_BW_*.
+int IIM42652_configure(uint8_t odr, uint8_t acc_range, uint8_t gyro_range, uint8_t filters)
+{
+    if (odr < IIM42652_ODR_32KHZ || odr > IIM42652_ODR_500HZ ||
+        odr == IIM42652_ODR_6_25HZ || odr == IIM42652_ODR_3_125HZ || odr == IIM42652_ODR_1_5625HZ)
+    {
+        return -EINVAL;
+    }
+    if (acc_range >= ARRAY_SIZE(acc_lsb_per_g) || gyro_range >= ARRAY_SIZE(gyro_lsb_per_dps) ||
+        filters > IIM42652_UI_FILT_BW_LL_MAX)
+    {
+        return -EINVAL;
+    }
+    if (iim42652_instance.fifo_enabled && !IIM42652_fifo_odr_valid(odr))
+    {
+        return -EINVAL;
+    }
+
+    iim42652_instance.odr = odr;
+    iim42652_instance.acc_range = acc_range;
+    iim42652_instance.gyro_range = gyro_range;
+    iim42652_instance.filters = filters;
+    iim42652_instance.acc_scale = 1.0f / acc_lsb_per_g[acc_range];
+    iim42652_instance.gyro_scale = 1.0f / gyro_lsb_per_dps[gyro_range];
+
+    if (!iim42652_instance.initialized)
+    {
+        // Applied by IIM42652_init
+        IIM42652_init();
+        return iim42652_instance.initialized ? 0 : -ENODEV;
+    }
+    if (iim42652_instance.wom_active)
+    {
+        // Applied by IIM42652_wom_disable
+        return 0;
+    }
+
+    int rc = IIM42652_write_sensor_config(odr, acc_range, gyro_range, filters);
+    if (rc < 0)
+    {
+        return rc;
+    }
+
+    // Packets already queued were taken with the old scale
+    if (iim42652_instance.fifo_enabled)
+    {
+        return IIM42652_fifo_flush();
+    }
+    return 0;
+}
+
+float IIM42652_odr_hz(uint8_t odr)
+{
+    if (odr >= ARRAY_SIZE(odr_hz))
+    {
+        return 0.0f;
+    }
+    return odr_hz[odr];
+}
+
+void IIM42652_get_config(uint8_t *odr, uint8_t *acc_range, uint8_t *gyro_range)
+{
+    *odr = iim42652_instance.odr;
+    *acc_range = iim42652_instance.acc_range;
+    *gyro_range = iim42652_instance.gyro_range;
+}
+
+bool IIM42652_is_initialized(void)
+{
+    return iim42652_instance.initialized;
+}
+
+float IIM42652_acc_scale(void)
+{
+    return iim42652_instance.acc_scale;
+}
+
+float IIM42652_gyro_scale(void)
+{
+    return iim42652_instance.gyro_scale;
+}
+
+#ifdef CONFIG_IIM42652_CALIB_SETTINGS
+// Offsets stored under imu/offsets. Loaded before the IMU is brought up, so they only
+// go to the instance here and IIM42652_init writes them to the part.
+static int IIM42652_settings_set(const char *name, size_t len, settings_read_cb read_cb, void *cb_arg)
+{
+    iim42652_offsets_t offsets;
+
+    if (!settings_name_steq(name, "offsets", NULL))
+    {
+        return -ENOENT;
+    }
+    if (len != sizeof(offsets))
+    {
+        return -EINVAL;
+    }
+    ssize_t rc = read_cb(cb_arg, &offsets, sizeof(offsets));
+    if (rc < 0)
+    {
+        return rc;
+    }
+    iim42652_instance.offsets = offsets;
+    return 0;
+}
+
+SETTINGS_STATIC_HANDLER_DEFINE(iim42652, "imu", NULL, IIM42652_settings_set, NULL, NULL);
+#endif
+
+// Apply offsets to the part and keep them for the next initialization and boot
+int IIM42652_set_offsets(const iim42652_offsets_t *offsets)
+{
+    for (int axis = 0; axis < 3; axis++)
+    {
+        if (abs(offsets->gyro[axis]) > IIM42652_OFFSET_MAX || abs(offsets->acc[axis]) > IIM42652_OFFSET_MAX)
+        {
+            return -EINVAL;
+        }
+    }
+
+    iim42652_instance.offsets = *offsets;
+    if (iim42652_instance.initialized)
+    {
+        int rc = IIM42652_write_offsets(offsets);
+        if (rc < 0)
+        {
+            return rc;
+        }
+    }
+#ifdef CONFIG_IIM42652_CALIB_SETTINGS
+    return settings_save_one("imu/offsets", offsets, sizeof(*offsets));
+#else
+    return 0;
+#endif
+}
+
+void IIM42652_get_offsets(iim42652_offsets_t *offsets)
+{
+    *offsets = iim42652_instance.offsets;
+}
+
+// Self-test and calibration conditions: FIFO and interrupts off, 1 kHz, +-4 g, +-250 dps,
+// both sensors in low noise mode
+static int IIM42652_calib_setup(void)
+{
+    if (!iim42652_instance.initialized)
+    {
+        IIM42652_init();
+        if (!iim42652_instance.initialized)
+        {
+            return -ENODEV;
+        }
+    }
+    if (iim42652_instance.wom_active)
+    {
+        IIM42652_wom_disable();
+    }
+    if (iim42652_instance.fifo_enabled)
+    {
+        IIM42652_fifo_disable();
+    }
+    IIM42652_write_register(IIM42652_INT_SOURCE0, 0);
+
+    int rc = IIM42652_write_sensor_config(IIM42652_ODR_1KHZ, IIM42652_RANGE_PM4G, IIM42652_RANGE_PM250dps,
+                                          IIM42652_UI_FILT_BW_ODR_DIV10);
+    if (rc < 0)
+    {
+        return rc;
+    }
+    IIM42652_write_register(IIM42652_PWR_MGMT0, IIM42652_GYRO_MODE_LN | IIM42652_ACCEL_MODE_LN);
+    // Gyro start-up plus filter settling
+    k_sleep(K_MSEC(100));
+    return 0;
+}
+
+static int IIM42652_calib_restore(void)
+{
+    IIM42652_write_register(IIM42652_SELF_TEST_CONFIG, 0);
+    return IIM42652_write_sensor_config(iim42652_instance.odr, iim42652_instance.acc_range,
+                                        iim42652_instance.gyro_range, iim42652_instance.filters);
+}
+
+// Mean of count UI samples, acc in [0..2] and gyro in [3..5]. The peak-to-peak of each
+// axis goes to spread. Samples are polled at about the 1 kHz output rate.
+static int IIM42652_average(int32_t mean[6], int32_t spread[6], int count)
+{
+    int32_t sum[6] = {0};
+    int32_t min[6];
+    int32_t max[6];
+    iim42652_raw_t raw;
+
+    for (int i = 0; i < 6; i++)
+    {
+        min[i] = INT32_MAX;
+        max[i] = INT32_MIN;
+    }
+    for (int n = 0; n < count; n++)
+    {
+        k_sleep(K_MSEC(1));
+        if (IIM42652_data_raw(&raw) < 0)
+        {
+            return -EIO;
+        }
+        for (int axis = 0; axis < 3; axis++)
+        {
+            const int32_t values[2] = {raw.acc[axis], raw.gyro[axis]};
+            for (int s = 0; s < 2; s++)
+            {
+                int i = axis + 3 * s;
+                sum[i] += values[s];
+                min[i] = MIN(min[i], values[s]);
+                max[i] = MAX(max[i], values[s]);
+            }
+        }
+    }
+    for (int i = 0; i < 6; i++)
+    {
+        mean[i] = sum[i] / count;
+        spread[i] = max[i] - min[i];
+    }
+    return 0;
+}
+
+// Self-test response relative to the factory trimmed one. ST_DATA 0 means no trim
+// was stored, the nominal response is used instead.
+static float IIM42652_st_ratio(int32_t delta, uint8_t code, float nominal)
+{
+    float expected = code ? nominal * powf(1.01f, (float)code - 1.0f) : nominal;
+
+    return fabsf((float)delta) / expected;
+}
+
+// Run the built-in self-test of all six axes. The part is excited electrostatically and
+// the output change compared with the factory response stored in XG/YG/ZG_ST_DATA and
+// XA/YA/ZA_ST_DATA. Returns 0 when the test ran, check result->passed for the outcome.
+// The configured ODR and ranges are restored afterwards.
+int IIM42652_self_test(iim42652_self_test_t *result)
+{
+    int32_t normal[6], gyro_st[6], acc_st[6], spread[6];
+    uint8_t gyro_code[3], acc_code[3];
+
+    int rc = IIM42652_calib_setup();
+    if (rc < 0)
+    {
+        return rc;
+    }
+    rc = IIM42652_reg_read_burst(IIM42652_REG_BANK_1, IIM42652_XG_ST_DATA, gyro_code, sizeof(gyro_code));
+    if (rc == 0)
+    {
+        rc = IIM42652_reg_read_burst(IIM42652_REG_BANK_2, IIM42652_XA_ST_DATA, acc_code, sizeof(acc_code));
+    }
+    if (rc == 0)
+    {
+        rc = IIM42652_average(normal, spread, IIM42652_ST_SAMPLES);
+    }
+    if (rc == 0)
+    {
+        IIM42652_write_register(IIM42652_SELF_TEST_CONFIG, IIM42652_ST_GYRO);
+        k_sleep(K_MSEC(IIM42652_ST_SETTLE_MS));
+        rc = IIM42652_average(gyro_st, spread, IIM42652_ST_SAMPLES);
+    }
+    if (rc == 0)
+    {
+        IIM42652_write_register(IIM42652_SELF_TEST_CONFIG, IIM42652_ACCEL_ST_POWER | IIM42652_ST_ACCEL);
+        k_sleep(K_MSEC(IIM42652_ST_SETTLE_MS));
+        rc = IIM42652_average(acc_st, spread, IIM42652_ST_SAMPLES);
+    }
+    IIM42652_calib_restore();
+    if (rc < 0)
+    {
+        return rc;
+    }
+
+    result->passed = 0;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        result->gyro_response[axis] =
+            IIM42652_st_ratio(gyro_st[3 + axis] - normal[3 + axis], gyro_code[axis], IIM42652_ST_GYRO_NOMINAL);
+        result->acc_response[axis] =
+            IIM42652_st_ratio(acc_st[axis] - normal[axis], acc_code[axis], IIM42652_ST_ACC_NOMINAL);
+        if (result->gyro_response[axis] > IIM42652_ST_GYRO_MIN_RATIO)
+        {
+            result->passed |= IIM42652_ST_GYRO_X << axis;
+        }
+        if (result->acc_response[axis] > IIM42652_ST_ACC_MIN_RATIO &&
+            result->acc_response[axis] < IIM42652_ST_ACC_MAX_RATIO)
+        {
+            result->passed |= IIM42652_ST_ACCEL_X << axis;
+        }
+    }
+    return 0;
+}
+
+// Measure the bias of a stationary part and cancel it in silicon through OFFSET_USER.
+// Gyro bias is the mean rate; for the accel the axis closest to vertical keeps 1 g.
+// Returns -EAGAIN when the part moved during the capture and -ERANGE when the bias
+// exceeds the offset range, in both cases the previous offsets stay in place.
+int IIM42652_calibrate(iim42652_offsets_t *offsets)
+{
+    static const iim42652_offsets_t no_offsets;
+    const iim42652_offsets_t previous = iim42652_instance.offsets;
+    int32_t mean[6], spread[6];
+
+    int rc = IIM42652_calib_setup();
+    if (rc < 0)
+    {
+        return rc;
+    }
+    // The part adds the offsets to its output, measure without them
+    rc = IIM42652_write_offsets(&no_offsets);
+    if (rc == 0)
+    {
+        k_sleep(K_MSEC(IIM42652_ST_SETTLE_MS));
+        rc = IIM42652_average(mean, spread, IIM42652_ST_SAMPLES);
+    }
+    IIM42652_calib_restore();
+    if (rc < 0)
+    {
+        IIM42652_write_offsets(&previous);
+        return rc;
+    }
+
+    int vertical = 0;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        if (spread[axis] > IIM42652_CALIB_ACC_STILL_MG * IIM42652_ST_ACC_LSB_PER_G / 1000.0f ||
+            spread[3 + axis] > IIM42652_CALIB_GYRO_STILL_DPS * IIM42652_ST_GYRO_LSB_PER_DPS)
+        {
+            IIM42652_write_offsets(&previous);
+            return -EAGAIN;
+        }
+        if (abs(mean[axis]) > abs(mean[vertical]))
+        {
+            vertical = axis;
+        }
+    }
+    mean[vertical] -= mean[vertical] < 0 ? -(int32_t)IIM42652_ST_ACC_LSB_PER_G : (int32_t)IIM42652_ST_ACC_LSB_PER_G;
+
+    iim42652_offsets_t result;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        float acc = -mean[axis] * (IIM42652_OFFSET_ACC_LSB_PER_G / IIM42652_ST_ACC_LSB_PER_G);
+        float gyro = -mean[3 + axis] * (IIM42652_OFFSET_GYRO_LSB_PER_DPS / IIM42652_ST_GYRO_LSB_PER_DPS);
+        if (fabsf(acc) > IIM42652_OFFSET_MAX || fabsf(gyro) > IIM42652_OFFSET_MAX)
+        {
+            IIM42652_write_offsets(&previous);
+            return -ERANGE;
+        }
+        result.acc[axis] = (int16_t)lroundf(acc);
+        result.gyro[axis] = (int16_t)lroundf(gyro);
+    }
+
+    rc = IIM42652_set_offsets(&result);
+    if (rc < 0)
+    {
+        return rc;
+    }
+    if (offsets)
+    {
+        *offsets = result;
+    }
+    return 0;
+}
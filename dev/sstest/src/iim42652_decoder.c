@@ -0,0 +1,322 @@
+// Decoder for buffers produced by the iim42652 sensor device, see iim42652_sensor.h.
+// Output follows the sensor subsystem conventions: m/s^2, rad/s and Celsius as Q31 with a shift.
+#include "iim42652_sensor.h"
+#include <string.h>
+#include <zephyr/drivers/sensor.h>
+#include <zephyr/dsp/types.h>
+
+// Full scale in micro units and the matching Q31 shift, indexed by the FS_SEL register value
+static const struct
+{
+    int64_t full_scale; // um/s^2
+    int8_t shift;
+} acc_fs[] = {
+    [IIM42652_RANGE_PM16G] = {156906400, 8},
+    [IIM42652_RANGE_PM8G] = {78453200, 7},
+    [IIM42652_RANGE_PM4G] = {39226600, 6},
+    [IIM42652_RANGE_PM2G] = {19613300, 5},
+};
+
+static const struct
+{
+    int64_t full_scale; // urad/s
+    int8_t shift;
+} gyro_fs[] = {
+    [IIM42652_RANGE_PM2kdps] = {34906585, 6},
+    [IIM42652_RANGE_PM1kdps] = {17453293, 5},
+    [IIM42652_RANGE_PM500dps] = {8726646, 4},
+    [IIM42652_RANGE_PM250dps] = {4363323, 3},
+    [IIM42652_RANGE_PM125dps] = {2181662, 2},
+    [IIM42652_RANGE_PM62_5dps] = {1090831, 1},
+    [IIM42652_RANGE_PM31_25dps] = {545415, 0},
+    [IIM42652_RANGE_PM15_625dps] = {272708, -1},
+};
+
+// Packet 4 carries 20-bit values at fixed sensitivities whatever FS_SEL is set to:
+// 2^19 / 8192 LSB/g = 64 g and 2^19 / 131 LSB/dps = 4002 dps
+#define IIM42652_HIRES_ACC_FS 627625600 // um/s^2
+#define IIM42652_HIRES_ACC_SHIFT 10
+#define IIM42652_HIRES_GYRO_FS 69851541 // urad/s
+#define IIM42652_HIRES_GYRO_SHIFT 7
+
+#define IIM42652_TEMP_SHIFT 8 // +-256 C
+
+// raw / 2^(bits - 1) * full_scale / 1e6, expressed as Q31 with the given shift
+static q31_t iim42652_to_q31(int32_t raw, uint8_t bits, int64_t full_scale, int8_t shift)
+{
+    int64_t value = ((int64_t)raw * full_scale) * (INT64_C(1) << (32 - bits));
+
+    if (shift >= 0)
+    {
+        return (q31_t)(value / (INT64_C(1000000) << shift));
+    }
+    return (q31_t)((value * (INT64_C(1) << -shift)) / INT64_C(1000000));
+}
+
+static q31_t iim42652_temp_to_q31(int16_t raw)
+{
+    // Milli Celsius: raw * 1000 / 132.48 + 25000 = raw * 100000 / 13248 + 25000
+    int64_t milli_c = ((int64_t)raw * 100000) / 13248 + 25000;
+
+    return (q31_t)((milli_c << (31 - IIM42652_TEMP_SHIFT)) / 1000);
+}
+
+static bool iim42652_chan_supported(enum sensor_channel chan)
+{
+    switch (chan)
+    {
+    case SENSOR_CHAN_ACCEL_X:
+    case SENSOR_CHAN_ACCEL_Y:
+    case SENSOR_CHAN_ACCEL_Z:
+    case SENSOR_CHAN_ACCEL_XYZ:
+    case SENSOR_CHAN_GYRO_X:
+    case SENSOR_CHAN_GYRO_Y:
+    case SENSOR_CHAN_GYRO_Z:
+    case SENSOR_CHAN_GYRO_XYZ:
+    case SENSOR_CHAN_DIE_TEMP:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// One decoded frame, acc/gyro are 16 or 20 bits depending on the packet format
+struct iim42652_frame
+{
+    int32_t acc[3];
+    int32_t gyro[3];
+    int16_t temp;
+    uint16_t timestamp; // FIFO timestamp, 0 for packets 1/2 and one-shot reads
+    size_t size;        // Packet size, 0 for a one-shot read
+};
+
+static bool iim42652_hires(const struct iim42652_encoded_data *edata)
+{
+    return edata->header.fifo_packets && edata->header.packet_size == IIM42652_FIFO_PACKET_SIZE_HIRES;
+}
+
+static size_t iim42652_frame_decode(const struct iim42652_encoded_data *edata, uint16_t frame,
+                                    struct iim42652_frame *out)
+{
+    if (edata->header.fifo_packets == 0)
+    {
+        iim42652_raw_t raw;
+        memcpy(&raw, edata->payload, sizeof(raw));
+        for (int axis = 0; axis < 3; axis++)
+        {
+            out->acc[axis] = raw.acc[axis];
+            out->gyro[axis] = raw.gyro[axis];
+        }
+        out->temp = raw.temp;
+        out->timestamp = 0;
+        out->size = 0;
+        return 1;
+    }
+
+    out->size = IIM42652_fifo_packet_decode(&edata->payload[frame * edata->header.packet_size], out->acc,
+                                            out->gyro, &out->temp, &out->timestamp);
+    return out->size;
+}
+
+// Valid FIFO packets at the start of the buffer, parsing stops like IIM42652_fifo_parse
+static uint16_t iim42652_fifo_frames(const struct iim42652_encoded_data *edata)
+{
+    struct iim42652_frame frame;
+    uint16_t frames = 0;
+
+    for (uint16_t i = 0; i < edata->header.fifo_packets; i++)
+    {
+        if (iim42652_frame_decode(edata, i, &frame) != edata->header.packet_size)
+        {
+            break;
+        }
+        frames++;
+    }
+    return frames;
+}
+
+static uint16_t iim42652_frame_count(const struct iim42652_encoded_data *edata)
+{
+    return edata->header.fifo_packets ? iim42652_fifo_frames(edata) : 1;
+}
+
+// Sample and timestamp of one frame. FIFO frames are timed backwards from the newest
+// packet using the 16-bit microsecond FIFO timestamps, or the ODR period for packets
+// without one.
+static void iim42652_frame(const struct iim42652_encoded_data *edata, uint16_t frame, uint16_t frames,
+                           struct iim42652_frame *out, uint64_t *timestamp)
+{
+    struct iim42652_frame last;
+
+    iim42652_frame_decode(edata, frame, out);
+    if (out->size == 0)
+    {
+        *timestamp = edata->header.timestamp;
+        return;
+    }
+    if (out->size == IIM42652_FIFO_PACKET_SIZE_SINGLE)
+    {
+        uint64_t period_ns = (uint64_t)(NSEC_PER_SEC / IIM42652_odr_hz(edata->header.odr));
+        *timestamp = edata->header.timestamp - (uint64_t)(frames - 1 - frame) * period_ns;
+        return;
+    }
+
+    iim42652_frame_decode(edata, frames - 1, &last);
+    *timestamp = edata->header.timestamp - (uint64_t)(uint16_t)(last.timestamp - out->timestamp) * NSEC_PER_USEC;
+}
+
+static int iim42652_decoder_get_frame_count(const uint8_t *buffer, struct sensor_chan_spec chan_spec,
+                                            uint16_t *frame_count)
+{
+    const struct iim42652_encoded_data *edata = (const struct iim42652_encoded_data *)buffer;
+
+    if (chan_spec.chan_idx != 0 || !iim42652_chan_supported(chan_spec.chan_type))
+    {
+        return -ENOTSUP;
+    }
+    *frame_count = iim42652_frame_count(edata);
+    return 0;
+}
+
+static int iim42652_decoder_get_size_info(struct sensor_chan_spec chan_spec, size_t *base_size,
+                                          size_t *frame_size)
+{
+    switch (chan_spec.chan_type)
+    {
+    case SENSOR_CHAN_ACCEL_XYZ:
+    case SENSOR_CHAN_GYRO_XYZ:
+        *base_size = sizeof(struct sensor_three_axis_data);
+        *frame_size = sizeof(struct sensor_three_axis_sample_data);
+        return 0;
+    case SENSOR_CHAN_ACCEL_X:
+    case SENSOR_CHAN_ACCEL_Y:
+    case SENSOR_CHAN_ACCEL_Z:
+    case SENSOR_CHAN_GYRO_X:
+    case SENSOR_CHAN_GYRO_Y:
+    case SENSOR_CHAN_GYRO_Z:
+    case SENSOR_CHAN_DIE_TEMP:
+        *base_size = sizeof(struct sensor_q31_data);
+        *frame_size = sizeof(struct sensor_q31_sample_data);
+        return 0;
+    default:
+        return -ENOTSUP;
+    }
+}
+
+static int iim42652_decoder_decode(const uint8_t *buffer, struct sensor_chan_spec chan_spec, uint32_t *fit,
+                                   uint16_t max_count, void *data_out)
+{
+    const struct iim42652_encoded_data *edata = (const struct iim42652_encoded_data *)buffer;
+    const struct iim42652_encoded_header *header = &edata->header;
+    enum sensor_channel chan = chan_spec.chan_type;
+
+    if (chan_spec.chan_idx != 0 || !iim42652_chan_supported(chan))
+    {
+        return -ENOTSUP;
+    }
+    if (header->acc_range >= ARRAY_SIZE(acc_fs) || header->gyro_range >= ARRAY_SIZE(gyro_fs))
+    {
+        return -EINVAL;
+    }
+
+    // Resolution, full scale and shift of the values in this buffer
+    const bool hires = iim42652_hires(edata);
+    const uint8_t bits = hires ? 20 : 16;
+    const int64_t acc_full_scale = hires ? IIM42652_HIRES_ACC_FS : acc_fs[header->acc_range].full_scale;
+    const int8_t acc_shift = hires ? IIM42652_HIRES_ACC_SHIFT : acc_fs[header->acc_range].shift;
+    const int64_t gyro_full_scale = hires ? IIM42652_HIRES_GYRO_FS : gyro_fs[header->gyro_range].full_scale;
+    const int8_t gyro_shift = hires ? IIM42652_HIRES_GYRO_SHIFT : gyro_fs[header->gyro_range].shift;
+
+    uint16_t frames = iim42652_frame_count(edata);
+    uint16_t count = 0;
+    uint64_t base_timestamp = 0;
+    struct iim42652_frame frame;
+    uint64_t timestamp;
+
+    for (; *fit < frames && count < max_count; (*fit)++, count++)
+    {
+        iim42652_frame(edata, *fit, frames, &frame, &timestamp);
+        if (count == 0)
+        {
+            base_timestamp = timestamp;
+        }
+        uint32_t delta = (uint32_t)(timestamp - base_timestamp);
+
+        if (chan == SENSOR_CHAN_ACCEL_XYZ || chan == SENSOR_CHAN_GYRO_XYZ)
+        {
+            struct sensor_three_axis_data *out = data_out;
+            bool acc = chan == SENSOR_CHAN_ACCEL_XYZ;
+            const int32_t *values = acc ? frame.acc : frame.gyro;
+            int64_t full_scale = acc ? acc_full_scale : gyro_full_scale;
+
+            out->header.base_timestamp_ns = base_timestamp;
+            out->header.reading_count = count + 1;
+            out->shift = acc ? acc_shift : gyro_shift;
+            out->readings[count].timestamp_delta = delta;
+            for (int axis = 0; axis < 3; axis++)
+            {
+                out->readings[count].values[axis] = iim42652_to_q31(values[axis], bits, full_scale, out->shift);
+            }
+            continue;
+        }
+
+        struct sensor_q31_data *out = data_out;
+        out->header.base_timestamp_ns = base_timestamp;
+        out->header.reading_count = count + 1;
+        out->readings[count].timestamp_delta = delta;
+        switch (chan)
+        {
+        case SENSOR_CHAN_ACCEL_X:
+        case SENSOR_CHAN_ACCEL_Y:
+        case SENSOR_CHAN_ACCEL_Z:
+            out->shift = acc_shift;
+            out->readings[count].value =
+                iim42652_to_q31(frame.acc[chan - SENSOR_CHAN_ACCEL_X], bits, acc_full_scale, acc_shift);
+            break;
+        case SENSOR_CHAN_GYRO_X:
+        case SENSOR_CHAN_GYRO_Y:
+        case SENSOR_CHAN_GYRO_Z:
+            out->shift = gyro_shift;
+            out->readings[count].value =
+                iim42652_to_q31(frame.gyro[chan - SENSOR_CHAN_GYRO_X], bits, gyro_full_scale, gyro_shift);
+            break;
+        default:
+            out->shift = IIM42652_TEMP_SHIFT;
+            out->readings[count].temperature = iim42652_temp_to_q31(frame.temp);
+            break;
+        }
+    }
+
+    return count;
+}
+
+static bool iim42652_decoder_has_trigger(const uint8_t *buffer, enum sensor_trigger_type trigger)
+{
+    const struct iim42652_encoded_data *edata = (const struct iim42652_encoded_data *)buffer;
+
+    switch (trigger)
+    {
+    case SENSOR_TRIG_DATA_READY:
+        return edata->header.events & IIM42652_INT_DATA_READY;
+    case SENSOR_TRIG_FIFO_WATERMARK:
+        return edata->header.events & IIM42652_INT_FIFO_THS;
+    case SENSOR_TRIG_FIFO_FULL:
+        return edata->header.events & IIM42652_INT_FIFO_FULL;
+    default:
+        return false;
+    }
+}
+
+SENSOR_DECODER_API_DT_DEFINE() = {
+    .get_frame_count = iim42652_decoder_get_frame_count,
+    .get_size_info = iim42652_decoder_get_size_info,
+    .decode = iim42652_decoder_decode,
+    .has_trigger = iim42652_decoder_has_trigger,
+};
+
+int iim42652_get_decoder(const struct device *dev, const struct sensor_decoder_api **decoder)
+{
+    ARG_UNUSED(dev);
+    *decoder = &SENSOR_DECODER_NAME();
+    return 0;
+}
@@ -0,0 +1,353 @@
+// SPI emulator for the IIM42652, lets the driver and the sensor device run on native_sim.
+// Models the register banks, the FIFO, clear-on-read INT_STATUS, the TMST strobe and the INT1 line.
+#define DT_DRV_COMPAT invensense_iim42652
+
+#include "iim42652_sensor.h"
+#include <string.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/emul.h>
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/drivers/spi.h>
+#include <zephyr/drivers/spi_emul.h>
+#include <zephyr/sys/util.h>
+#ifdef CONFIG_GPIO_EMUL
+#include <zephyr/drivers/gpio/gpio_emul.h>
+#endif
+
+#define IIM42652_EMUL_BANKS 5
+#define IIM42652_EMUL_REGS 128
+#define IIM42652_EMUL_WHO_AM_I 0x6F
+
+struct iim42652_emul_cfg
+{
+    struct gpio_dt_spec int_gpio;
+};
+
+struct iim42652_emul_data
+{
+    uint8_t bank;
+    uint8_t regs[IIM42652_EMUL_BANKS][IIM42652_EMUL_REGS];
+    uint8_t fifo[IIM42652_FIFO_SIZE];
+    uint16_t fifo_head; // Next byte to read
+    uint16_t fifo_len;  // Bytes stored
+    uint16_t lost_packets;
+};
+
+// Packet 4 when FIFO_HIRES_EN is set, packet 3 otherwise
+static size_t iim42652_emul_packet_size(const struct iim42652_emul_data *data)
+{
+    return (data->regs[0][IIM42652_FIFO_CONFIG1] & IIM42652_FIFO_HIRES_EN) ? IIM42652_FIFO_PACKET_SIZE_HIRES
+                                                                          : IIM42652_FIFO_PACKET_SIZE;
+}
+
+static uint16_t iim42652_emul_fifo_packets(const struct iim42652_emul_data *data)
+{
+    return data->fifo_len / iim42652_emul_packet_size(data);
+}
+
+// INT1 follows INT_STATUS/INT_STATUS2 masked by INT_SOURCE0/INT_SOURCE1, like a latched interrupt
+static void iim42652_emul_update_int(const struct emul *target)
+{
+    const struct iim42652_emul_cfg *cfg = target->cfg;
+    struct iim42652_emul_data *data = target->data;
+    bool active = (data->regs[0][IIM42652_INT_STATUS] & data->regs[0][IIM42652_INT_SOURCE0]) ||
+                  (data->regs[0][IIM42652_INT_STATUS2] & data->regs[0][IIM42652_INT_SOURCE1]);
+
+#ifdef CONFIG_GPIO_EMUL
+    if (cfg->int_gpio.port)
+    {
+        gpio_emul_input_set(cfg->int_gpio.port, cfg->int_gpio.pin, active);
+    }
+#else
+    ARG_UNUSED(cfg);
+    ARG_UNUSED(active);
+#endif
+}
+
+static uint8_t iim42652_emul_read(const struct emul *target, uint8_t reg)
+{
+    struct iim42652_emul_data *data = target->data;
+    uint16_t count;
+
+    if (reg == IIM42652_REG_BANK_SEL)
+    {
+        return data->bank;
+    }
+    if (data->bank != 0)
+    {
+        return data->regs[data->bank][reg];
+    }
+
+    switch (reg)
+    {
+    case IIM42652_INT_STATUS:
+    case IIM42652_INT_STATUS2:
+    {
+        uint8_t status = data->regs[0][reg];
+        data->regs[0][reg] = 0;
+        iim42652_emul_update_int(target);
+        return status;
+    }
+    case IIM42652_FIFO_COUNTH:
+    case IIM42652_FIFO_COUNTL:
+        count = (data->regs[0][IIM42652_INTF_CONFIG0] & IIM42652_FIFO_COUNT_REC) ? iim42652_emul_fifo_packets(data)
+                                                                                 : data->fifo_len;
+        return reg == IIM42652_FIFO_COUNTH ? count >> 8 : count & 0xFF;
+    case IIM42652_FIFO_DATA:
+        if (data->fifo_len == 0)
+        {
+            return 0xFF;
+        }
+        uint8_t value = data->fifo[data->fifo_head];
+        data->fifo_head = (data->fifo_head + 1) % sizeof(data->fifo);
+        data->fifo_len--;
+        return value;
+    case IIM42652_FIFO_LOST_PKT0:
+        return data->lost_packets & 0xFF;
+    case IIM42652_FIFO_LOST_PKT1:
+        return data->lost_packets >> 8;
+    default:
+        return data->regs[0][reg];
+    }
+}
+
+static void iim42652_emul_write(const struct emul *target, uint8_t reg, uint8_t value)
+{
+    struct iim42652_emul_data *data = target->data;
+
+    if (reg == IIM42652_REG_BANK_SEL)
+    {
+        data->bank = MIN(value, IIM42652_EMUL_BANKS - 1);
+        return;
+    }
+    if (data->bank == 0 && reg == IIM42652_SIGNAL_PATH_RESET)
+    {
+        if (value & IIM42652_FIFO_FLUSH)
+        {
+            data->fifo_head = 0;
+            data->fifo_len = 0;
+        }
+        if (value & IIM42652_TMST_STROBE)
+        {
+            // Sensor time runs off the emulated uptime
+            uint32_t tmst = k_ticks_to_us_floor64(k_uptime_ticks()) & IIM42652_TMST_MASK;
+            data->regs[1][IIM42652_TMSTVAL0] = tmst & 0xFF;
+            data->regs[1][IIM42652_TMSTVAL1] = (tmst >> 8) & 0xFF;
+            data->regs[1][IIM42652_TMSTVAL2] = tmst >> 16;
+        }
+        return; // Self clearing
+    }
+    data->regs[data->bank][reg] = value;
+    if (data->bank == 0 && (reg == IIM42652_INT_SOURCE0 || reg == IIM42652_INT_SOURCE1))
+    {
+        iim42652_emul_update_int(target);
+    }
+}
+
+// Fetch byte pos of a buffer set, 0 past the end or for NULL buffers
+static uint8_t iim42652_emul_buf_get(const struct spi_buf_set *set, size_t pos)
+{
+    for (size_t i = 0; set && i < set->count; i++)
+    {
+        if (pos < set->buffers[i].len)
+        {
+            return set->buffers[i].buf ? ((const uint8_t *)set->buffers[i].buf)[pos] : 0;
+        }
+        pos -= set->buffers[i].len;
+    }
+    return 0;
+}
+
+static void iim42652_emul_buf_put(const struct spi_buf_set *set, size_t pos, uint8_t value)
+{
+    for (size_t i = 0; set && i < set->count; i++)
+    {
+        if (pos < set->buffers[i].len)
+        {
+            if (set->buffers[i].buf)
+            {
+                ((uint8_t *)set->buffers[i].buf)[pos] = value;
+            }
+            return;
+        }
+        pos -= set->buffers[i].len;
+    }
+}
+
+static size_t iim42652_emul_buf_len(const struct spi_buf_set *set)
+{
+    size_t len = 0;
+
+    for (size_t i = 0; set && i < set->count; i++)
+    {
+        len += set->buffers[i].len;
+    }
+    return len;
+}
+
+static int iim42652_emul_io(const struct emul *target, const struct spi_config *config,
+                            const struct spi_buf_set *tx_bufs, const struct spi_buf_set *rx_bufs)
+{
+    struct iim42652_emul_data *data = target->data;
+    size_t len = MAX(iim42652_emul_buf_len(tx_bufs), iim42652_emul_buf_len(rx_bufs));
+
+    ARG_UNUSED(config);
+
+    if (len == 0)
+    {
+        return 0;
+    }
+
+    uint8_t cmd = iim42652_emul_buf_get(tx_bufs, 0);
+    uint8_t reg = cmd & 0x7F;
+    bool read = cmd & 0x80;
+
+    iim42652_emul_buf_put(rx_bufs, 0, 0);
+    for (size_t pos = 1; pos < len; pos++)
+    {
+        if (read)
+        {
+            iim42652_emul_buf_put(rx_bufs, pos, iim42652_emul_read(target, reg));
+        }
+        else
+        {
+            iim42652_emul_write(target, reg, iim42652_emul_buf_get(tx_bufs, pos));
+        }
+        // FIFO_DATA does not auto increment so bursts drain the FIFO
+        if (reg != IIM42652_FIFO_DATA || data->bank != 0)
+        {
+            reg = (reg + 1) & 0x7F;
+        }
+    }
+    return 0;
+}
+
+void iim42652_emul_set_reading(const struct emul *target, const iim42652_raw_t *raw)
+{
+    struct iim42652_emul_data *data = target->data;
+    const int16_t values[] = {raw->temp, raw->acc[0], raw->acc[1], raw->acc[2],
+                              raw->gyro[0], raw->gyro[1], raw->gyro[2]};
+
+    for (size_t i = 0; i < ARRAY_SIZE(values); i++)
+    {
+        data->regs[0][IIM42652_TEMP_DATA1_UI + 2 * i] = (uint16_t)values[i] >> 8;
+        data->regs[0][IIM42652_TEMP_DATA0_UI + 2 * i] = (uint16_t)values[i] & 0xFF;
+    }
+    data->regs[0][IIM42652_INT_STATUS] |= IIM42652_INT_DATA_READY;
+    iim42652_emul_update_int(target);
+}
+
+// Append one packet (header, accel, gyro, temp, timestamp) and raise the FIFO interrupts.
+// In high resolution mode raw fills bits [19:4] of packet 4, the low nibbles read 0.
+int iim42652_emul_push_fifo(const struct emul *target, const iim42652_raw_t *raw, uint16_t timestamp)
+{
+    struct iim42652_emul_data *data = target->data;
+    const size_t size = iim42652_emul_packet_size(data);
+    uint8_t pkt[IIM42652_FIFO_PACKET_SIZE_HIRES] = {0};
+
+    if (data->fifo_len + size > sizeof(data->fifo))
+    {
+        data->lost_packets++;
+        data->regs[0][IIM42652_INT_STATUS] |= IIM42652_INT_FIFO_FULL;
+        iim42652_emul_update_int(target);
+        return -ENOSPC;
+    }
+
+    pkt[0] = IIM42652_FIFO_HEADER_ACCEL | IIM42652_FIFO_HEADER_GYRO;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        pkt[1 + 2 * axis] = (uint16_t)raw->acc[axis] >> 8;
+        pkt[2 + 2 * axis] = (uint16_t)raw->acc[axis] & 0xFF;
+        pkt[7 + 2 * axis] = (uint16_t)raw->gyro[axis] >> 8;
+        pkt[8 + 2 * axis] = (uint16_t)raw->gyro[axis] & 0xFF;
+    }
+    if (size == IIM42652_FIFO_PACKET_SIZE_HIRES)
+    {
+        pkt[0] |= IIM42652_FIFO_HEADER_20;
+        pkt[13] = (uint16_t)raw->temp >> 8;
+        pkt[14] = (uint16_t)raw->temp & 0xFF;
+        pkt[15] = timestamp >> 8;
+        pkt[16] = timestamp & 0xFF;
+    }
+    else
+    {
+        pkt[13] = (uint8_t)(int8_t)(raw->temp / 64);
+        pkt[14] = timestamp >> 8;
+        pkt[15] = timestamp & 0xFF;
+    }
+
+    for (size_t i = 0; i < size; i++)
+    {
+        data->fifo[(data->fifo_head + data->fifo_len + i) % sizeof(data->fifo)] = pkt[i];
+    }
+    data->fifo_len += size;
+
+    uint16_t watermark = ((uint16_t)(data->regs[0][IIM42652_FIFO_CONFIG3] & 0x0F) << 8) |
+                         data->regs[0][IIM42652_FIFO_CONFIG2];
+    if (watermark && iim42652_emul_fifo_packets(data) >= watermark)
+    {
+        data->regs[0][IIM42652_INT_STATUS] |= IIM42652_INT_FIFO_THS;
+    }
+    if (data->fifo_len + size > sizeof(data->fifo))
+    {
+        data->regs[0][IIM42652_INT_STATUS] |= IIM42652_INT_FIFO_FULL;
+    }
+    iim42652_emul_update_int(target);
+    return 0;
+}
+
+// Raise wake-on-motion / significant motion events (IIM42652_INT_WOM_*, IIM42652_INT_SMD).
+// Only reported while the detector is enabled in SMD_CONFIG, as on the part.
+void iim42652_emul_motion(const struct emul *target, uint8_t events)
+{
+    struct iim42652_emul_data *data = target->data;
+
+    if ((data->regs[0][IIM42652_SMD_CONFIG] & 0x03) == IIM42652_SMD_MODE_DISABLED)
+    {
+        return;
+    }
+    data->regs[0][IIM42652_INT_STATUS2] |= events & (IIM42652_INT_WOM | IIM42652_INT_SMD);
+    iim42652_emul_update_int(target);
+}
+
+uint8_t iim42652_emul_get_reg(const struct emul *target, uint8_t bank, uint8_t reg)
+{
+    struct iim42652_emul_data *data = target->data;
+
+    if (bank >= IIM42652_EMUL_BANKS || reg >= IIM42652_EMUL_REGS)
+    {
+        return 0;
+    }
+    return data->regs[bank][reg];
+}
+
+static int iim42652_emul_init(const struct emul *target, const struct device *parent)
+{
+    struct iim42652_emul_data *data = target->data;
+
+    ARG_UNUSED(parent);
+
+    memset(data, 0, sizeof(*data));
+    for (int bank = 0; bank < IIM42652_EMUL_BANKS; bank++)
+    {
+        data->regs[bank][IIM42652_WHO_AM_I] = IIM42652_EMUL_WHO_AM_I;
+    }
+    // Power-on defaults the driver relies on: big endian FIFO count, async reset set
+    data->regs[0][IIM42652_INTF_CONFIG0] = 0x30;
+    data->regs[0][IIM42652_INT_CONFIG1] = IIM42652_INT_ASYNC_RESET;
+    return 0;
+}
+
+static const struct spi_emul_api iim42652_emul_spi_api = {
+    .io = iim42652_emul_io,
+};
+
+#define IIM42652_EMUL(n)                                                                                             \
+    static const struct iim42652_emul_cfg iim42652_emul_cfg_##n = {                                                  \
+        .int_gpio = GPIO_DT_SPEC_INST_GET_OR(n, int_gpios, {0}),                                                     \
+    };                                                                                                               \
+    static struct iim42652_emul_data iim42652_emul_data_##n;                                                         \
+    EMUL_DT_INST_DEFINE(n, iim42652_emul_init, &iim42652_emul_data_##n, &iim42652_emul_cfg_##n,                     \
+                        &iim42652_emul_spi_api, NULL)
+
+DT_INST_FOREACH_STATUS_OKAY(IIM42652_EMUL)
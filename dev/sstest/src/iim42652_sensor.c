@@ -0,0 +1,406 @@
+// Zephyr sensor device on top of the IIM42652 driver: one-shot reads and FIFO
+// streaming through the RTIO submit/decoder API (sensor_read, sensor_stream).
+#define DT_DRV_COMPAT invensense_iim42652
+
+#include "iim42652_sensor.h"
+#include <zephyr/device.h>
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/drivers/sensor.h>
+#include <zephyr/drivers/spi.h>
+#include <zephyr/rtio/rtio.h>
+#include <zephyr/sys/util.h>
+
+BUILD_ASSERT(DT_NUM_INST_STATUS_OKAY(DT_DRV_COMPAT) <= 1,
+             "The IIM42652 driver supports a single instance");
+
+struct iim42652_sensor_config
+{
+    struct spi_dt_spec spi;
+    struct gpio_dt_spec int_gpio;
+};
+
+struct iim42652_sensor_data
+{
+    struct k_spinlock lock;
+    struct k_mutex bus_lock; // Serializes the driver calls of the submit paths, attr_set and the drain
+    struct k_work drain_work;
+    struct rtio_iodev_sqe *stream_sqe; // Pending stream request, completed on the next FIFO event
+    struct rtio_iodev_sqe *drain_sqe;  // Request whose FIFO drain is in flight
+    uint64_t event_timestamp;          // Uptime in ns of the last INT1 edge
+    bool stream_armed;
+    bool stream_include_data;
+    bool stream_drop_data;
+    uint8_t stream_events; // IIM42652_INT_* requested by the stream triggers
+};
+
+static const struct iim42652_sensor_config iim42652_sensor_config_0 = {
+    .spi = SPI_DT_SPEC_INST_GET(0, IIM42652_SPI_OPERATION, 0),
+    .int_gpio = GPIO_DT_SPEC_INST_GET_OR(0, int_gpios, {0}),
+};
+static struct iim42652_sensor_data iim42652_sensor_data_0;
+
+static uint64_t iim42652_uptime_ns(void)
+{
+    return k_ticks_to_ns_floor64(k_uptime_ticks());
+}
+
+static void iim42652_fill_header(struct iim42652_encoded_header *header, uint64_t timestamp, uint8_t events,
+                                 uint16_t fifo_packets)
+{
+    header->timestamp = timestamp;
+    IIM42652_get_config(&header->odr, &header->acc_range, &header->gyro_range);
+    header->events = events;
+    header->fifo_packets = fifo_packets;
+    header->packet_size = IIM42652_fifo_packet_size();
+    header->reserved = 0;
+}
+
+static void iim42652_submit_one_shot(struct iim42652_sensor_data *data, struct rtio_iodev_sqe *iodev_sqe)
+{
+    const uint32_t min_len = sizeof(struct iim42652_encoded_data) + sizeof(iim42652_raw_t);
+    uint8_t *buf;
+    uint32_t buf_len;
+
+    int rc = rtio_sqe_rx_buf(iodev_sqe, min_len, min_len, &buf, &buf_len);
+    if (rc < 0)
+    {
+        rtio_iodev_sqe_err(iodev_sqe, rc);
+        return;
+    }
+
+    struct iim42652_encoded_data *edata = (struct iim42652_encoded_data *)buf;
+    iim42652_raw_t raw;
+    k_mutex_lock(&data->bus_lock, K_FOREVER);
+    rc = IIM42652_data_raw(&raw);
+    if (rc < 0)
+    {
+        k_mutex_unlock(&data->bus_lock);
+        rtio_iodev_sqe_err(iodev_sqe, -EIO);
+        return;
+    }
+    iim42652_fill_header(&edata->header, iim42652_uptime_ns(), 0, 0);
+    k_mutex_unlock(&data->bus_lock);
+    memcpy(edata->payload, &raw, sizeof(raw));
+    rtio_iodev_sqe_ok(iodev_sqe, 0);
+}
+
+// INT1 edge in streaming mode, runs in ISR context
+static void iim42652_stream_event(void)
+{
+    struct iim42652_sensor_data *data = &iim42652_sensor_data_0;
+
+    data->event_timestamp = iim42652_uptime_ns();
+    k_work_submit(&data->drain_work);
+}
+
+static void iim42652_drain_done(const struct device *spi, int result, void *user_data)
+{
+    struct iim42652_sensor_data *data = user_data;
+    struct rtio_iodev_sqe *iodev_sqe = data->drain_sqe;
+
+    ARG_UNUSED(spi);
+
+    if (result < 0)
+    {
+        rtio_iodev_sqe_err(iodev_sqe, result);
+    }
+    else
+    {
+        rtio_iodev_sqe_ok(iodev_sqe, 0);
+    }
+    // Cleared after the completion, a multishot resubmission is in stream_sqe by now
+    k_spinlock_key_t key = k_spin_lock(&data->lock);
+    data->drain_sqe = NULL;
+    k_spin_unlock(&data->lock, key);
+}
+
+// Nobody consumes the stream any more, stop the FIFO and INT1 until the next sensor_stream()
+static void iim42652_stream_disarm(void)
+{
+    IIM42652_int_disable();
+    IIM42652_fifo_disable();
+    IIM42652_set_event_handler(NULL);
+}
+
+static void iim42652_drain(struct iim42652_sensor_data *data)
+{
+    uint8_t status;
+    uint16_t count = 0;
+
+    // A cancelled request is dropped, like one that was not resubmitted after its completion
+    k_spinlock_key_t key = k_spin_lock(&data->lock);
+    struct rtio_iodev_sqe *iodev_sqe = data->stream_sqe;
+    data->stream_sqe = NULL;
+    if (iodev_sqe && FIELD_GET(RTIO_SQE_CANCELED, iodev_sqe->sqe.flags))
+    {
+        iodev_sqe = NULL;
+    }
+    bool disarm = !iodev_sqe && !data->drain_sqe && data->stream_armed;
+    if (disarm)
+    {
+        data->stream_armed = false;
+    }
+    k_spin_unlock(&data->lock, key);
+
+    if (disarm)
+    {
+        iim42652_stream_disarm();
+        return;
+    }
+    if (IIM42652_int_status(&status) < 0)
+    {
+        if (iodev_sqe)
+        {
+            rtio_iodev_sqe_err(iodev_sqe, -EIO);
+        }
+        return;
+    }
+    if (!iodev_sqe)
+    {
+        // The previous drain is still in flight, the samples go with the next event
+        return;
+    }
+    if (!(status & data->stream_events))
+    {
+        // Unrequested event, keep waiting for the next one
+        key = k_spin_lock(&data->lock);
+        data->stream_sqe = iodev_sqe;
+        k_spin_unlock(&data->lock, key);
+        return;
+    }
+
+    uint64_t timestamp = data->event_timestamp;
+    if (data->stream_include_data)
+    {
+        if (IIM42652_fifo_count(&count) < 0)
+        {
+            rtio_iodev_sqe_err(iodev_sqe, -EIO);
+            return;
+        }
+        // Packets keep arriving between the INT1 edge and the count read, the newest one
+        // counted is dated by the read and the decoder times the others back from it
+        timestamp = iim42652_uptime_ns();
+    }
+    else if (data->stream_drop_data)
+    {
+        // The event is reported without its samples
+        IIM42652_fifo_flush();
+    }
+    const size_t packet_size = IIM42652_fifo_packet_size();
+    count = MIN(count, IIM42652_FIFO_SIZE / packet_size);
+
+    const uint32_t min_len = sizeof(struct iim42652_encoded_data) + count * packet_size;
+    uint8_t *buf;
+    uint32_t buf_len;
+    int rc = rtio_sqe_rx_buf(iodev_sqe, min_len, min_len, &buf, &buf_len);
+    if (rc < 0)
+    {
+        // Out of buffers, drop the batch so the FIFO does not overflow
+        IIM42652_fifo_flush();
+        rtio_iodev_sqe_err(iodev_sqe, rc);
+        return;
+    }
+
+    struct iim42652_encoded_data *edata = (struct iim42652_encoded_data *)buf;
+    iim42652_fill_header(&edata->header, timestamp, status, count);
+    if (count == 0)
+    {
+        rtio_iodev_sqe_ok(iodev_sqe, 0);
+        return;
+    }
+
+    // The packets are transferred by SPI DMA straight into the consumer's buffer
+    data->drain_sqe = iodev_sqe;
+    rc = IIM42652_fifo_read_cb(edata->payload, count, iim42652_drain_done, data);
+    if (rc < 0)
+    {
+        data->drain_sqe = NULL;
+        rtio_iodev_sqe_err(iodev_sqe, rc);
+    }
+}
+
+static void iim42652_drain_work(struct k_work *work)
+{
+    struct iim42652_sensor_data *data = CONTAINER_OF(work, struct iim42652_sensor_data, drain_work);
+
+    k_mutex_lock(&data->bus_lock, K_FOREVER);
+    iim42652_drain(data);
+    k_mutex_unlock(&data->bus_lock);
+}
+
+// INT1 events and data handling requested by the stream triggers
+static int iim42652_stream_config(const struct sensor_read_config *cfg, uint8_t *events, bool *include_data,
+                                  bool *drop_data)
+{
+    *events = 0;
+    *include_data = false;
+    *drop_data = false;
+
+    for (size_t i = 0; i < cfg->count; i++)
+    {
+        switch (cfg->triggers[i].trigger)
+        {
+        case SENSOR_TRIG_FIFO_WATERMARK:
+            *events |= IIM42652_INT_FIFO_THS;
+            break;
+        case SENSOR_TRIG_FIFO_FULL:
+            *events |= IIM42652_INT_FIFO_FULL;
+            break;
+        default:
+            return -ENOTSUP;
+        }
+        if (cfg->triggers[i].opt == SENSOR_STREAM_DATA_INCLUDE)
+        {
+            *include_data = true;
+        }
+        else if (cfg->triggers[i].opt == SENSOR_STREAM_DATA_DROP)
+        {
+            *drop_data = true;
+        }
+    }
+    return 0;
+}
+
+static void iim42652_submit_stream(const struct device *dev, struct rtio_iodev_sqe *iodev_sqe)
+{
+    const struct sensor_read_config *cfg = iodev_sqe->sqe.iodev->data;
+    struct iim42652_sensor_data *data = dev->data;
+    uint8_t events;
+    bool include_data;
+    bool drop_data;
+
+    int rc = iim42652_stream_config(cfg, &events, &include_data, &drop_data);
+    if (rc < 0)
+    {
+        rtio_iodev_sqe_err(iodev_sqe, rc);
+        return;
+    }
+
+    // Resubmissions of a multishot stream land here from the drain completion, possibly in
+    // ISR context, and only hand the request over without touching the bus
+    k_spinlock_key_t key = k_spin_lock(&data->lock);
+    if (data->stream_armed && data->stream_events == events && data->stream_include_data == include_data &&
+        data->stream_drop_data == drop_data)
+    {
+        data->stream_sqe = iodev_sqe;
+        k_spin_unlock(&data->lock, key);
+        return;
+    }
+    k_spin_unlock(&data->lock, key);
+
+    k_mutex_lock(&data->bus_lock, K_FOREVER);
+    IIM42652_set_event_handler(iim42652_stream_event);
+    if (!data->stream_armed)
+    {
+        rc = IIM42652_fifo_enable(CONFIG_IIM42652_STREAM_WATERMARK);
+    }
+    if (rc == 0)
+    {
+        rc = IIM42652_int_enable(events);
+    }
+    if (rc == 0)
+    {
+        // Published before the bus is released, so the drain never sees an armed stream
+        // without its request
+        key = k_spin_lock(&data->lock);
+        data->stream_events = events;
+        data->stream_include_data = include_data;
+        data->stream_drop_data = drop_data;
+        data->stream_armed = true;
+        data->stream_sqe = iodev_sqe;
+        k_spin_unlock(&data->lock, key);
+    }
+    k_mutex_unlock(&data->bus_lock);
+    if (rc < 0)
+    {
+        rtio_iodev_sqe_err(iodev_sqe, rc);
+    }
+}
+
+static void iim42652_submit(const struct device *dev, struct rtio_iodev_sqe *iodev_sqe)
+{
+    const struct sensor_read_config *cfg = iodev_sqe->sqe.iodev->data;
+    struct iim42652_sensor_data *data = dev->data;
+
+    if (!IIM42652_is_initialized())
+    {
+        k_mutex_lock(&data->bus_lock, K_FOREVER);
+        IIM42652_init();
+        k_mutex_unlock(&data->bus_lock);
+        if (!IIM42652_is_initialized())
+        {
+            rtio_iodev_sqe_err(iodev_sqe, -ENODEV);
+            return;
+        }
+    }
+
+    if (!cfg->is_streaming)
+    {
+        iim42652_submit_one_shot(data, iodev_sqe);
+    }
+    else if (IS_ENABLED(CONFIG_IIM42652_STREAM))
+    {
+        iim42652_submit_stream(dev, iodev_sqe);
+    }
+    else
+    {
+        rtio_iodev_sqe_err(iodev_sqe, -ENOTSUP);
+    }
+}
+
+// SENSOR_ATTR_SAMPLING_FREQUENCY picks the closest supported ODR at or above the request
+static int iim42652_attr_set(const struct device *dev, enum sensor_channel chan, enum sensor_attribute attr,
+                             const struct sensor_value *val)
+{
+    static const uint8_t odrs[] = {
+        IIM42652_ODR_12_5HZ, IIM42652_ODR_25HZ, IIM42652_ODR_50HZ, IIM42652_ODR_100HZ,
+        IIM42652_ODR_200HZ, IIM42652_ODR_500HZ, IIM42652_ODR_1KHZ, IIM42652_ODR_2KHZ,
+        IIM42652_ODR_4KHZ, IIM42652_ODR_8KHZ, IIM42652_ODR_16KHZ, IIM42652_ODR_32KHZ,
+    };
+    struct iim42652_sensor_data *data = dev->data;
+    uint8_t odr, acc_range, gyro_range;
+
+    ARG_UNUSED(chan);
+
+    if (attr != SENSOR_ATTR_SAMPLING_FREQUENCY)
+    {
+        return -ENOTSUP;
+    }
+
+    float hz = sensor_value_to_float(val);
+    k_mutex_lock(&data->bus_lock, K_FOREVER);
+    IIM42652_get_config(&odr, &acc_range, &gyro_range);
+    odr = odrs[ARRAY_SIZE(odrs) - 1];
+    for (size_t i = 0; i < ARRAY_SIZE(odrs); i++)
+    {
+        if (IIM42652_odr_hz(odrs[i]) >= hz)
+        {
+            odr = odrs[i];
+            break;
+        }
+    }
+    int rc = IIM42652_configure(odr, acc_range, gyro_range, IIM42652_UI_FILT_BW_ODR_DIV4);
+    k_mutex_unlock(&data->bus_lock);
+    return rc;
+}
+
+static int iim42652_sensor_init(const struct device *dev)
+{
+    const struct iim42652_sensor_config *cfg = dev->config;
+    struct iim42652_sensor_data *data = dev->data;
+
+    // The sensor sits behind VDDP, which the board enables after boot, so
+    // the part itself is brought up lazily on the first request
+    k_mutex_init(&data->bus_lock);
+    k_work_init(&data->drain_work, iim42652_drain_work);
+    return IIM42652_attach(&cfg->spi, &cfg->int_gpio);
+}
+
+static const struct sensor_driver_api iim42652_sensor_api = {
+    .attr_set = iim42652_attr_set,
+    .submit = iim42652_submit,
+    .get_decoder = iim42652_get_decoder,
+};
+
+DEVICE_DT_INST_DEFINE(0, iim42652_sensor_init, NULL, &iim42652_sensor_data_0, &iim42652_sensor_config_0,
+                      POST_KERNEL, CONFIG_SENSOR_INIT_PRIORITY, &iim42652_sensor_api);
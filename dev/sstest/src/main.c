@@ -2,12 +2,143 @@
 #include "ble_nus.h"
 #include "sensors.h"
 #include "adc.h"
+#include "battery.h"
+#include "telemetry.h"
+#include "ble_batch.h"
+#include "ble_link.h"
+#include "ble_l2cap.h"
 #include <zephyr/kernel.h>
 #include "stts2004.h"
 #include "iim42652.h"
 #include <zephyr/drivers/gpio.h>
+#include <inttypes.h>
+#ifdef CONFIG_IIM42652_CALIB_SETTINGS
+#include <zephyr/settings/settings.h>
+#endif
 
-static void send_sensor_json(double temp, const iim42652_data_t *iim_data)
+// The FIFO watermark is derived from the ODR so the thread wakes at about 20 Hz
+#define IMU_WAKEUP_RATE_HZ 20
+#define IMU_EVENT_TIMEOUT K_MSEC(1000)
+// Timeouts in a row after which INT1 is taken as not wired and the thread polls instead
+#define IMU_EVENT_TIMEOUT_MAX 3
+#define IMU_POLL_PERIOD K_MSEC(50)
+#define IMU_DRAIN_TIMEOUT_MS 100 // A FIFO drain takes a few ms, log when it takes longer
+#define IMU_THREAD_STACK_SIZE 2048
+#define IMU_THREAD_PRIORITY 5
+// Sensor time base correlation period, keeps the sample times locked to the uptime
+#define IMU_TMST_SYNC_PERIOD_MS 1000
+
+// Duty cycling: after IMU_IDLE_TIMEOUT_MS without motion the gyro, the FIFO stream and the
+// BLE traffic stop and the accelerometer waits for motion in low power mode
+#define IMU_IDLE_TIMEOUT_MS 30000
+#define IMU_IDLE_ACC_MG 20.0f  // Peak-to-peak per axis and batch still counted as idle
+#define IMU_IDLE_GYRO_DPS 2.0f
+#define IMU_WOM_THRESHOLD_MG 50 // Sample to sample change that wakes the node up
+
+// Average current model behind the battery runtime estimate
+#define LOAD_BASE_UA 150          // MCU idle, regulators, STTS2004, SAADC
+#define LOAD_IMU_LN_UA 1000       // IIM42652 accel and gyro in low noise mode
+#define LOAD_IMU_WOM_UA 20        // Accel only, low power at 50 Hz
+#define LOAD_IMU_FAST_UA 400      // FIFO drains and encoding above 1 kHz ODR
+#define LOAD_RADIO_UA_PER_HZ 15   // Per notification per second, one is sent per FIFO wakeup
+
+// TX power per battery level, lower power shortens the range but saves the radio peaks
+#define TX_POWER_NORMAL_DBM 0
+#define TX_POWER_LOW_DBM -8
+#define TX_POWER_CRITICAL_DBM -20
+
+#define COMMAND_PROFILE_MONITOR 'l'
+#define COMMAND_PROFILE_VIBRATION 'h'
+#define COMMAND_CALIBRATE 'c'
+#define COMMAND_STREAM_JSON 'j'
+#define COMMAND_STREAM_BINARY 'b'
+#define COMMAND_STREAM_DELTA 'd'
+
+typedef struct
+{
+	const char *name;
+	uint8_t odr;
+	uint8_t acc_range;
+	uint8_t gyro_range;
+	uint8_t filters;
+} imu_profile_t;
+
+// In increasing rate, the battery level caps the profile
+enum
+{
+	IMU_PROFILE_SAVER,
+	IMU_PROFILE_MONITOR,
+	IMU_PROFILE_VIBRATION,
+};
+
+static const imu_profile_t imu_profiles[] = {
+	[IMU_PROFILE_SAVER] = {"saver", IIM42652_ODR_25HZ, IIM42652_RANGE_PM2G,
+						   IIM42652_RANGE_PM250dps, IIM42652_UI_FILT_BW_ODR_DIV4},
+	[IMU_PROFILE_MONITOR] = {"monitor", IIM42652_ODR_50HZ, IIM42652_RANGE_PM2G,
+							 IIM42652_RANGE_PM250dps, IIM42652_UI_FILT_BW_ODR_DIV4},
+	[IMU_PROFILE_VIBRATION] = {"vibration", IIM42652_ODR_4KHZ, IIM42652_RANGE_PM16G,
+							   IIM42652_RANGE_PM2kdps, IIM42652_UI_FILT_BW_ODR_DIV2},
+};
+
+// Profile requested over BLE, applied by the IMU thread which owns the SPI bus
+static atomic_t imu_profile_request = ATOMIC_INIT(IMU_PROFILE_MONITOR);
+// Profile the central asked for and the highest one the battery allows
+static atomic_t imu_profile_user = ATOMIC_INIT(IMU_PROFILE_MONITOR);
+static atomic_t imu_profile_cap = ATOMIC_INIT(IMU_PROFILE_VIBRATION);
+// Applied profile and duty cycle state, input of the battery load model
+static atomic_t imu_profile_active = ATOMIC_INIT(IMU_PROFILE_MONITOR);
+static atomic_t imu_idle;
+static uint16_t imu_watermark;
+// Self-test and bias calibration requested over BLE, run by the IMU thread as well
+static atomic_t imu_calib_request;
+
+static iim42652_fifo_sample_t imu_samples[IIM42652_FIFO_MAX_PACKETS];
+
+// The IMU thread is the only user of the FIFO, INT1 and the driver state behind them.
+// The sensor device drives the same resources and is meant for applications without it.
+BUILD_ASSERT(!IS_ENABLED(CONFIG_IIM42652_SENSOR), "CONFIG_IIM42652_SENSOR conflicts with the IMU thread");
+
+// Double buffered FIFO drains, one is filled by SPI DMA while the other is encoded
+static uint8_t imu_fifo_raw[2][IIM42652_FIFO_MAX_PACKETS * IIM42652_FIFO_PACKET_SIZE];
+static struct k_poll_signal imu_fifo_signal = K_POLL_SIGNAL_INITIALIZER(imu_fifo_signal);
+
+// Latest temperature, updated by the main loop and attached to IMU frames
+static double last_temperature;
+
+// The main loop forwards the sensor channels to the central, at its own pace
+ZBUS_SUBSCRIBER_DEFINE(main_sub, 8);
+ZBUS_CHAN_ADD_OBS(sensor_imu_chan, main_sub, 0);
+ZBUS_CHAN_ADD_OBS(sensor_temp_chan, main_sub, 0);
+ZBUS_CHAN_ADD_OBS(sensor_battery_chan, main_sub, 0);
+
+// Uptime of the last batch with motion, drives the idle timeout
+static int64_t imu_last_motion;
+
+// Sensor stream format, selected by the central. Errors and status stay JSON.
+enum
+{
+	TELEMETRY_MODE_JSON,
+	TELEMETRY_MODE_BINARY, // One frame per IMU sample
+	TELEMETRY_MODE_DELTA,  // IMU samples delta coded in blocks
+};
+
+#if defined(CONFIG_TELEMETRY_DELTA)
+#define TELEMETRY_MODE_DEFAULT TELEMETRY_MODE_DELTA
+#elif defined(CONFIG_TELEMETRY_BINARY)
+#define TELEMETRY_MODE_DEFAULT TELEMETRY_MODE_BINARY
+#else
+#define TELEMETRY_MODE_DEFAULT TELEMETRY_MODE_JSON
+#endif
+static atomic_t telemetry_mode = ATOMIC_INIT(TELEMETRY_MODE_DEFAULT);
+
+// IMU thread side of the binary stream
+static telemetry_stream_t imu_stream;
+static uint8_t imu_stream_block[TELEMETRY_BLOCK_MAX];
+static atomic_val_t imu_stream_mode;
+static bool imu_stream_l2cap;
+
+// timestamp_ns is the uptime of the IMU sample, sent in us so the host can plot by sample time
+static void send_sensor_json(double temp, const iim42652_data_t *iim_data, uint64_t timestamp_ns)
 {
 	char json[512];
 	double voltage = 0.0;
@@ -20,17 +151,19 @@ static void send_sensor_json(double temp, const iim42652_data_t *iim_data)
 	{
 		snprintf(json, sizeof(json),
 				 "{"
+				 "\"ts\":%" PRIu64 ","
 				 "\"temperature\":%.2f,"
 				 "\"voltage\":%.3f,"
 				 "\"acc\":[%.2f,%.2f,%.2f],"
 				 "\"gyro\":[%.2f,%.2f,%.2f],"
 				 "\"imu_temp\":%.2f"
 				 "}\n",
+				 timestamp_ns / NSEC_PER_USEC,
 				 temp,
 				 voltage,
-				 iim_data->acc[0], iim_data->acc[1], iim_data->acc[2],
-				 iim_data->gyro[0], iim_data->gyro[1], iim_data->gyro[2],
-				 iim_data->temp);
+				 (double)iim_data->acc[0], (double)iim_data->acc[1], (double)iim_data->acc[2],
+				 (double)iim_data->gyro[0], (double)iim_data->gyro[1], (double)iim_data->gyro[2],
+				 (double)iim_data->temp);
 	}
 	else
 	{
@@ -45,6 +178,57 @@ static void send_sensor_json(double temp, const iim42652_data_t *iim_data)
 	bt_nus_printf("%s", json);
 }
 
+// Queue one telemetry frame, sent with the next MTU sized notification
+static void send_telemetry(const telemetry_sample_t *sample)
+{
+	uint8_t frame[TELEMETRY_FRAME_MAX];
+
+	int len = telemetry_encode(sample, frame, sizeof(frame));
+	if (len > 0)
+	{
+		ble_batch_add(frame, len);
+	}
+}
+
+// Binary counterpart of the temperature and voltage fields of send_sensor_json, the IMU
+// samples are streamed separately by the IMU thread
+static void send_environment_binary(double temp)
+{
+	telemetry_sample_t sample = {
+		.timestamp_ns = k_ticks_to_ns_floor64(k_uptime_ticks()),
+		.sensors = TELEMETRY_SENSOR_TEMP,
+		.temperature = (float)temp,
+	};
+	double voltage;
+
+	if (adc_measure(&voltage) == 0)
+	{
+		sample.voltage = (float)voltage;
+		sample.sensors |= TELEMETRY_SENSOR_VOLTAGE;
+	}
+	send_telemetry(&sample);
+}
+
+static void send_batch_stats(void)
+{
+	ble_batch_stats_t stats;
+	char json[160];
+
+	ble_batch_stats(&stats, true);
+	if (stats.notifications == 0 && stats.dropped == 0)
+	{
+		return;
+	}
+	snprintf(json, sizeof(json),
+			 "{"
+			 "\"batch\":{\"notifications\":%u,\"frames\":%u,\"fill\":%.2f,\"deadline\":%u,\"dropped\":%u}"
+			 "}\n",
+			 stats.notifications, stats.frames,
+			 stats.capacity ? (double)stats.bytes / stats.capacity : 0.0,
+			 stats.deadline_flushes, stats.dropped);
+	bt_nus_printf("%s", json);
+}
+
 // Function to send an error message as JSON over BLE
 static void send_error_json(const char *error_msg)
 {
@@ -57,37 +241,623 @@ static void send_error_json(const char *error_msg)
 	bt_nus_printf("%s", json);
 }
 
-int main(void)
+// Link parameters after each negotiation, runs on the system workqueue
+static void send_link_json(const ble_link_info_t *info)
+{
+	char json[192];
+	snprintf(json, sizeof(json),
+			 "{"
+			 "\"link\":{\"profile\":%u,\"mtu\":%u,\"data_len\":%u,\"tx_phy\":%u,\"rx_phy\":%u,"
+			 "\"interval_us\":%u,\"latency\":%u,\"timeout_ms\":%u}"
+			 "}\n",
+			 info->profile, info->mtu, info->tx_octets, info->tx_phy, info->rx_phy,
+			 info->interval * 1250U, info->latency, info->timeout * 10U);
+	bt_nus_printf("%s", json);
+}
+
+// Ask the IMU thread for a profile, capped by the battery level. Returns the one requested.
+static int imu_request_profile(int profile)
+{
+	atomic_set(&imu_profile_user, profile);
+	profile = MIN(profile, (int)atomic_get(&imu_profile_cap));
+	atomic_set(&imu_profile_request, profile);
+	return profile;
+}
+
+static void on_ble_received(const uint8_t *data, uint16_t len)
+{
+	if (len == 0)
+	{
+		return;
+	}
+
+	switch (data[0])
+	{
+	case COMMAND_PROFILE_MONITOR:
+		imu_request_profile(IMU_PROFILE_MONITOR);
+		break;
+
+	case COMMAND_PROFILE_VIBRATION:
+		if (imu_request_profile(IMU_PROFILE_VIBRATION) != IMU_PROFILE_VIBRATION)
+		{
+			send_error_json("Battery low, profile limited");
+		}
+		break;
+
+	case COMMAND_CALIBRATE:
+		atomic_set(&imu_calib_request, 1);
+		break;
+
+	case COMMAND_STREAM_JSON:
+		atomic_set(&telemetry_mode, TELEMETRY_MODE_JSON);
+		break;
+
+	case COMMAND_STREAM_BINARY:
+		atomic_set(&telemetry_mode, TELEMETRY_MODE_BINARY);
+		break;
+
+	case COMMAND_STREAM_DELTA:
+		atomic_set(&telemetry_mode, TELEMETRY_MODE_DELTA);
+		break;
+
+	default:
+		send_error_json("Unknown command");
+		break;
+	}
+}
+
+// Apply a pending profile request, returns true when the configuration changed
+static bool imu_apply_profile(void)
+{
+	atomic_val_t request = atomic_set(&imu_profile_request, -1);
+	if (request < 0 || request >= ARRAY_SIZE(imu_profiles))
+	{
+		return false;
+	}
+
+	const imu_profile_t *profile = &imu_profiles[request];
+	if (IIM42652_configure(profile->odr, profile->acc_range, profile->gyro_range, profile->filters) != 0)
+	{
+		printk("Failed to apply IMU profile %s\n", profile->name);
+		return false;
+	}
+
+	// Keep half of the FIFO as headroom for late wakeups
+	atomic_set(&imu_profile_active, request);
+	uint16_t watermark = IIM42652_odr_hz(profile->odr) / IMU_WAKEUP_RATE_HZ;
+	imu_watermark = CLAMP(watermark, 1, IIM42652_FIFO_MAX_PACKETS / 2);
+	printk("IMU profile %s, watermark %u\n", profile->name, imu_watermark);
+	return true;
+}
+
+static int imu_arm(void)
+{
+	int rc = IIM42652_fifo_enable(imu_watermark);
+	if (rc != 0)
+	{
+		return rc;
+	}
+	return IIM42652_int_enable(IIM42652_INT_FIFO_THS | IIM42652_INT_FIFO_FULL);
+}
+
+// Self-test followed by the bias calibration, the node has to lie still meanwhile.
+// The offsets are applied in the sensor and persisted by the driver.
+static void imu_calibrate(void)
+{
+	iim42652_self_test_t st;
+	iim42652_offsets_t offsets;
+	char json[160];
+
+	printk("IMU calibration, keep the node still\n");
+	if (IIM42652_self_test(&st) != 0)
+	{
+		send_error_json("IMU self-test failed");
+		return;
+	}
+	if (st.passed != (IIM42652_ST_GYRO | IIM42652_ST_ACCEL))
+	{
+		snprintf(json, sizeof(json),
+				 "{"
+				 "\"selftest\":\"fail\","
+				 "\"passed\":%u"
+				 "}\n",
+				 st.passed);
+		bt_nus_printf("%s", json);
+		return;
+	}
+
+	int rc = IIM42652_calibrate(&offsets);
+	if (rc != 0)
+	{
+		send_error_json(rc == -EAGAIN ? "IMU moved during calibration" : "IMU calibration failed");
+		return;
+	}
+	snprintf(json, sizeof(json),
+			 "{"
+			 "\"selftest\":\"pass\","
+			 "\"offsets\":{\"gyro\":[%d,%d,%d],\"acc\":[%d,%d,%d]}"
+			 "}\n",
+			 offsets.gyro[0], offsets.gyro[1], offsets.gyro[2],
+			 offsets.acc[0], offsets.acc[1], offsets.acc[2]);
+	bt_nus_printf("%s", json);
+}
+
+// Hand the newest sample to the consumers, never waits for them
+static void imu_publish(int status, const iim42652_data_t *iim_data, uint64_t timestamp_ns, uint16_t samples)
+{
+	struct sensor_imu_msg msg = {
+		.timestamp = timestamp_ns,
+		.status = status,
+		.samples = samples,
+	};
+
+	if (iim_data)
+	{
+		msg.data = *iim_data;
+	}
+	zbus_chan_pub(&sensor_imu_chan, &msg, K_NO_WAIT);
+}
+
+// Start a group of samples for the binary stream, false in JSON mode
+static bool imu_stream_begin(void)
+{
+	atomic_val_t mode = atomic_get(&telemetry_mode);
+	uint16_t size = ble_batch_capacity();
+	bool l2cap = ble_l2cap_sdu_size() > 0;
+
+	if (mode != imu_stream_mode || size == 0 || l2cap != imu_stream_l2cap)
+	{
+		// New receiver, transport or format, the next block starts a fresh delta chain
+		telemetry_stream_reset(&imu_stream);
+		imu_stream_mode = mode;
+		imu_stream_l2cap = l2cap;
+	}
+	if (mode == TELEMETRY_MODE_DELTA)
+	{
+		telemetry_block_begin(&imu_stream, imu_stream_block, MIN(size, sizeof(imu_stream_block)));
+	}
+	return mode != TELEMETRY_MODE_JSON;
+}
+
+static void imu_stream_send_block(void)
+{
+	int len = telemetry_block_end(&imu_stream);
+	if (len > 0)
+	{
+		ble_batch_add(imu_stream_block, len);
+	}
+}
+
+static void imu_stream_add(const iim42652_data_t *iim_data, uint64_t timestamp_ns)
+{
+	if (imu_stream_mode == TELEMETRY_MODE_BINARY)
+	{
+		telemetry_sample_t sample = {
+			.timestamp_ns = timestamp_ns,
+			.sensors = TELEMETRY_SENSOR_ACC | TELEMETRY_SENSOR_GYRO | TELEMETRY_SENSOR_IMU_TEMP,
+			.imu = *iim_data,
+		};
+		send_telemetry(&sample);
+	}
+	else if (imu_stream_mode == TELEMETRY_MODE_DELTA &&
+			 telemetry_block_add(&imu_stream, iim_data, timestamp_ns) == -ENOSPC)
+	{
+		// Block full, send it and carry on in the next one
+		imu_stream_send_block();
+		telemetry_block_begin(&imu_stream, imu_stream_block, MIN(ble_batch_capacity(), sizeof(imu_stream_block)));
+		telemetry_block_add(&imu_stream, iim_data, timestamp_ns);
+	}
+}
+
+static void imu_stream_end(void)
+{
+	if (imu_stream_mode == TELEMETRY_MODE_DELTA)
+	{
+		imu_stream_send_block();
+	}
+}
+
+// Polling fallback when INT1 is not wired or cannot be armed
+static void imu_poll_loop(void)
 {
 	iim42652_data_t iim_data;
-	double temperature;
+
+	while (1)
+	{
+		k_sleep(IMU_POLL_PERIOD);
+
+		imu_apply_profile();
+		if (atomic_cas(&imu_calib_request, 1, 0))
+		{
+			imu_calibrate();
+		}
+
+		if (IIM42652_data(&iim_data) != 0)
+		{
+			printk("Failed to read IIM42652 data\n");
+			imu_publish(-EIO, NULL, 0, 0);
+			continue;
+		}
+		// UI registers hold the newest sample, the read time is the best estimate available
+		uint64_t timestamp = k_ticks_to_ns_floor64(k_uptime_ticks());
+		imu_publish(0, &iim_data, timestamp, 1);
+		imu_stream_begin();
+		imu_stream_add(&iim_data, timestamp);
+		imu_stream_end();
+	}
+}
+
+// True when no axis of the batch moved more than the idle limits
+static bool imu_batch_still(const iim42652_fifo_sample_t *samples, int n)
+{
+	const float acc_limit = IMU_IDLE_ACC_MG / 1000.0f / IIM42652_acc_scale();
+	const float gyro_limit = IMU_IDLE_GYRO_DPS / IIM42652_gyro_scale();
+
+	for (int axis = 0; axis < 3; axis++)
+	{
+		int16_t acc_min = samples[0].raw.acc[axis], acc_max = acc_min;
+		int16_t gyro_min = samples[0].raw.gyro[axis], gyro_max = gyro_min;
+		for (int i = 1; i < n; i++)
+		{
+			acc_min = MIN(acc_min, samples[i].raw.acc[axis]);
+			acc_max = MAX(acc_max, samples[i].raw.acc[axis]);
+			gyro_min = MIN(gyro_min, samples[i].raw.gyro[axis]);
+			gyro_max = MAX(gyro_max, samples[i].raw.gyro[axis]);
+		}
+		if ((float)(acc_max - acc_min) > acc_limit || (float)(gyro_max - gyro_min) > gyro_limit)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+// Encode and forward one drained FIFO batch
+static void imu_process_batch(const uint8_t *raw, size_t packets)
+{
+	iim42652_data_t iim_data;
+
+	int n = IIM42652_fifo_parse(raw, packets, imu_samples);
+	if (n <= 0)
+	{
+		return;
+	}
+	if (!imu_batch_still(imu_samples, n))
+	{
+		imu_last_motion = k_uptime_get();
+	}
+	// The whole batch is acquired, the zbus channel and the JSON stream carry the newest sample
+	IIM42652_convert(&imu_samples[n - 1].raw, &iim_data, 1);
+	imu_publish(0, &iim_data, imu_samples[n - 1].timestamp, n);
+
+	// In binary modes every sample of the batch, packed into MTU sized notifications
+	if (imu_stream_begin())
+	{
+		for (int i = 0; i < n; i++)
+		{
+			IIM42652_convert(&imu_samples[i].raw, &iim_data, 1);
+			imu_stream_add(&iim_data, imu_samples[i].timestamp);
+		}
+		imu_stream_end();
+	}
+}
+
+static int imu_wait_drain(void)
+{
+	struct k_poll_event event = K_POLL_EVENT_INITIALIZER(K_POLL_TYPE_SIGNAL, K_POLL_MODE_NOTIFY_ONLY,
+														 &imu_fifo_signal);
+	unsigned int signaled;
+	int result;
+
+	int rc = k_poll(&event, 1, K_MSEC(IMU_DRAIN_TIMEOUT_MS));
+	if (rc == -EAGAIN)
+	{
+		// SPI transfers cannot be aborted, the DMA owns the buffer until the transfer ends
+		printk("IIM42652 FIFO drain slow, waiting for completion\n");
+		event.state = K_POLL_STATE_NOT_READY;
+		rc = k_poll(&event, 1, K_FOREVER);
+	}
+	if (rc < 0)
+	{
+		return rc;
+	}
+	k_poll_signal_check(&imu_fifo_signal, &signaled, &result);
+	return result;
+}
+
+// Stop streaming and wait in wake-on-motion mode, returns once the node moves again.
+// The active profile is restored on wake so capture resumes at its full rate.
+static void imu_sleep_until_motion(void)
+{
+	uint8_t status;
+
+	IIM42652_int_disable();
+	if (IIM42652_wom_enable(IMU_WOM_THRESHOLD_MG, IIM42652_SMD_MODE_WOM) != 0)
+	{
+		printk("Failed to enable IIM42652 wake-on-motion\n");
+		IIM42652_wom_disable();
+		return;
+	}
+	printk("IMU idle, waiting for motion\n");
+	atomic_set(&imu_idle, 1);
+	bt_nus_printf("{\"state\":\"idle\"}\n");
+	// Nothing streams until the node moves, trade latency for radio current
+	ble_link_set_profile(BLE_LINK_PROFILE_IDLE);
+
+	while (IIM42652_wait_event(K_FOREVER, &status) != 0 || !(status & IIM42652_INT_WOM))
+	{
+	}
+
+	IIM42652_wom_disable();
+	atomic_set(&imu_idle, 0);
+	printk("IMU motion detected\n");
+	ble_link_set_profile(BLE_LINK_PROFILE_STREAMING);
+	bt_nus_printf("{\"state\":\"active\"}\n");
+}
+
+// IMU acquisition thread, sleeps until INT1 signals a FIFO watermark
+static void imu_thread(void *arg1, void *arg2, void *arg3)
+{
+	ARG_UNUSED(arg1);
+	ARG_UNUSED(arg2);
+	ARG_UNUSED(arg3);
+
+	uint8_t status;
+	uint8_t fill = 0;   // Buffer the next drain goes to
+	size_t pending = 0; // Packets waiting in the other buffer
+	int timeouts = 0;   // IMU_EVENT_TIMEOUT expired without INT1 in a row
+	int64_t last_sync = k_uptime_get();
+	imu_last_motion = k_uptime_get();
+
+	imu_apply_profile();
+	if (imu_arm() != 0)
+	{
+		printk("IMU interrupt path unavailable, polling\n");
+		IIM42652_fifo_disable();
+		imu_poll_loop();
+		return;
+	}
+
+	while (1)
+	{
+		bool timed_out = IIM42652_wait_event(IMU_EVENT_TIMEOUT, &status) != 0;
+		if (timed_out)
+		{
+			// Either the sensor lost its configuration or INT1 is not on the devicetree pin.
+			// Drain whatever the FIFO holds so samples keep flowing in the meantime.
+			if (++timeouts >= IMU_EVENT_TIMEOUT_MAX)
+			{
+				printk("IIM42652 INT1 silent, polling\n");
+				if (pending > 0)
+				{
+					imu_process_batch(imu_fifo_raw[fill ^ 1], pending);
+				}
+				IIM42652_int_disable();
+				IIM42652_fifo_disable();
+				imu_poll_loop();
+				return;
+			}
+			printk("IIM42652 event timeout, draining the FIFO\n");
+			status = 0;
+		}
+		else
+		{
+			timeouts = 0;
+		}
+		if (status & IIM42652_INT_FIFO_FULL)
+		{
+			printk("IIM42652 FIFO overflow\n");
+		}
+
+		int n = IIM42652_fifo_read_async(imu_fifo_raw[fill], IIM42652_FIFO_MAX_PACKETS, &imu_fifo_signal);
+
+		// Encode the previous batch while the current one is transferred
+		if (pending > 0)
+		{
+			imu_process_batch(imu_fifo_raw[fill ^ 1], pending);
+			pending = 0;
+		}
+
+		if (n > 0 && imu_wait_drain() != 0)
+		{
+			// The failed transfer has ended, restart the FIFO from a known state
+			IIM42652_fifo_recover();
+			n = -EIO;
+		}
+		if (n < 0)
+		{
+			printk("Failed to read IIM42652 FIFO\n");
+			send_error_json("Failed to read IIM42652 FIFO");
+			imu_arm();
+			continue;
+		}
+		if (timed_out && n == 0)
+		{
+			// Nothing queued either, the sensor lost its configuration
+			imu_apply_profile();
+			imu_arm();
+			continue;
+		}
+		if (imu_apply_profile())
+		{
+			// Drained samples belong to the old configuration
+			imu_arm();
+			continue;
+		}
+		if (atomic_cas(&imu_calib_request, 1, 0))
+		{
+			// Calibration stops the FIFO, the batch in hand is still valid
+			if (n > 0)
+			{
+				imu_process_batch(imu_fifo_raw[fill], n);
+			}
+			imu_calibrate();
+			imu_last_motion = k_uptime_get();
+			imu_arm();
+			continue;
+		}
+		if (n > 0)
+		{
+			if (IIM42652_event_pending())
+			{
+				// The next watermark is already up, encode this batch while it is transferred
+				pending = n;
+				fill ^= 1;
+			}
+			else
+			{
+				imu_process_batch(imu_fifo_raw[fill], n);
+			}
+		}
+		// Only while no drain is in flight, the strobe goes through the same bus
+		if (k_uptime_get() - last_sync >= IMU_TMST_SYNC_PERIOD_MS)
+		{
+			IIM42652_timestamp_sync();
+			last_sync = k_uptime_get();
+		}
+		if (k_uptime_get() - imu_last_motion >= IMU_IDLE_TIMEOUT_MS)
+		{
+			// The batch still pending was taken while idle, nothing lost by dropping it
+			pending = 0;
+			imu_sleep_until_motion();
+			imu_last_motion = k_uptime_get();
+			imu_apply_profile();
+			imu_arm();
+		}
+	}
+}
+
+// Average current of the current duty cycle: the IMU mode and, while streaming, one
+// notification per FIFO wakeup
+static uint32_t power_load_ua(void)
+{
+	if (atomic_get(&imu_idle))
+	{
+		return LOAD_BASE_UA + LOAD_IMU_WOM_UA;
+	}
+	const imu_profile_t *profile = &imu_profiles[atomic_get(&imu_profile_active)];
+	float odr = IIM42652_odr_hz(profile->odr);
+	// Wakeups per second of the FIFO watermark in effect, about IMU_WAKEUP_RATE_HZ unless
+	// the ODR is too low or the watermark hits its cap
+	float wakeups = odr / MAX(imu_watermark, 1);
+	uint32_t load = LOAD_BASE_UA + LOAD_IMU_LN_UA + (uint32_t)(wakeups * LOAD_RADIO_UA_PER_HZ);
+	if (odr > 1000.0f)
+	{
+		load += LOAD_IMU_FAST_UA;
+	}
+	return load;
+}
+
+// Battery estimate and power policy: the level caps the IMU profile and sets the TX power
+static void power_update(const battery_state_t *state)
+{
+	static const struct
+	{
+		int profile_cap;
+		int8_t tx_power;
+	} policy[] = {
+		[BATTERY_LEVEL_NORMAL] = {IMU_PROFILE_VIBRATION, TX_POWER_NORMAL_DBM},
+		[BATTERY_LEVEL_LOW] = {IMU_PROFILE_MONITOR, TX_POWER_LOW_DBM},
+		[BATTERY_LEVEL_CRITICAL] = {IMU_PROFILE_SAVER, TX_POWER_CRITICAL_DBM},
+	};
+	static uint8_t level = BATTERY_LEVEL_NORMAL;
+	char json[128];
+
+	// Load of the duty cycle now in effect, used by the next estimate
+	battery_set_load(power_load_ua());
+	snprintf(json, sizeof(json),
+			 "{"
+			 "\"battery\":{\"voltage\":%.3f,\"soc\":%.1f,\"runtime_min\":%u,\"level\":%u}"
+			 "}\n",
+			 state->voltage, (double)state->soc, state->runtime_min, state->level);
+	bt_nus_printf("%s", json);
+
+	if (state->level == level)
+	{
+		return;
+	}
+	level = state->level;
+	printk("Battery level %u, SoC %.1f %%\n", level, (double)state->soc);
+	atomic_set(&imu_profile_cap, policy[level].profile_cap);
+	imu_request_profile(atomic_get(&imu_profile_user));
+	ble_set_tx_power(policy[level].tx_power);
+}
+
+K_THREAD_DEFINE(imu_thread_id, IMU_THREAD_STACK_SIZE, imu_thread, NULL, NULL, NULL,
+				IMU_THREAD_PRIORITY, 0, SYS_FOREVER_MS);
+
+int main(void)
+{
 	printk("Sample - Bluetooth Peripheral NUS\n");
 
 	brd_init();
+	ble_link_set_report_cb(send_link_json);
 	ble_init();
 	adc_init();
+	ble_set_rx_handler(on_ble_received);
+
+#ifdef CONFIG_IIM42652_CALIB_SETTINGS
+	// IMU calibration offsets, written to the part when the IMU thread brings it up
+	if (settings_subsys_init() != 0 || settings_load_subtree("imu") != 0)
+	{
+		printk("Failed to load IMU calibration\n");
+	}
+#endif
+
+	// The IMU is powered through VDDP, start acquisition once the board is up
+	k_thread_start(imu_thread_id);
+	sensor_init();
 
 	printk("Initialization complete\n");
 
 	while (1)
 	{
-		k_sleep(K_MSEC(50));
+		const struct zbus_channel *chan;
 
-		if (STTS2004_temperature(&temperature) != 0)
+		if (zbus_sub_wait(&main_sub, &chan, K_FOREVER) != 0)
 		{
-			printk("Failed to read temperature\n");
-			send_error_json("Failed to read temperature");
 			continue;
 		}
-		if (IIM42652_data(&iim_data) != 0)
+		if (chan == &sensor_imu_chan)
 		{
-			printk("Failed to read IIM42652 data\n");
-			send_error_json("Failed to read IIM42652 data");
-			send_sensor_json(temperature, NULL);
-			continue;
+			struct sensor_imu_msg msg;
+			zbus_chan_read(chan, &msg, K_NO_WAIT);
+			if (msg.status != 0)
+			{
+				send_error_json("Failed to read IIM42652 data");
+			}
+			if (atomic_get(&telemetry_mode) == TELEMETRY_MODE_JSON)
+			{
+				send_sensor_json(last_temperature, msg.status == 0 ? &msg.data : NULL, msg.timestamp);
+			}
+		}
+		else if (chan == &sensor_temp_chan)
+		{
+			struct sensor_temp_msg msg;
+			zbus_chan_read(chan, &msg, K_NO_WAIT);
+			if (msg.status != 0)
+			{
+				printk("Failed to read temperature\n");
+				send_error_json("Failed to read temperature");
+				continue;
+			}
+			last_temperature = msg.temperature;
+			if (atomic_get(&telemetry_mode) != TELEMETRY_MODE_JSON)
+			{
+				send_environment_binary(last_temperature);
+			}
+			if (msg.alarms & STTS2004_ALARM_CRITICAL)
+			{
+				send_error_json("Temperature critical");
+			}
+		}
+		else if (chan == &sensor_battery_chan)
+		{
+			struct sensor_battery_msg msg;
+			zbus_chan_read(chan, &msg, K_NO_WAIT);
+			power_update(&msg.state);
+			send_batch_stats();
 		}
-		send_sensor_json(temperature, &iim_data);
-		// Add
 	}
 
 	return 0;
@@ -1,5 +1,144 @@
+#include "sensors.h"
+#include "stts2004.h"
+#include <zephyr/kernel.h>
 
+#define SENSORS_THREAD_STACK_SIZE 1536
+#define SENSORS_THREAD_PRIORITY 7 // Below the IMU thread
 
-void sensor_task(void)
+// Temperature is read on STTS2004 alarm events, which track a window around the last
+// reading, and on a slow timer. Without the EVENT line the timer is all there is.
+#define TEMP_PERIOD_EVENT_MS 60000
+#define TEMP_PERIOD_POLL_MS 1000
+#define TEMP_MIN_INTERVAL_MS 1000 // EVENT may lag new limits by a conversion
+#define TEMP_WINDOW_C 0.5
+#define TEMP_CRITICAL_C 85.0
+#define TEMP_RESOLUTION STTS2004_RESOLUTION_0_25C
+
+ZBUS_CHAN_DEFINE(sensor_temp_chan, struct sensor_temp_msg, NULL, NULL, ZBUS_OBSERVERS_EMPTY, ZBUS_MSG_INIT(0));
+ZBUS_CHAN_DEFINE(sensor_battery_chan, struct sensor_battery_msg, NULL, NULL, ZBUS_OBSERVERS_EMPTY,
+                 ZBUS_MSG_INIT(0));
+ZBUS_CHAN_DEFINE(sensor_imu_chan, struct sensor_imu_msg, NULL, NULL, ZBUS_OBSERVERS_EMPTY, ZBUS_MSG_INIT(0));
+
+// One periodic sensor. run is called when the period expired or, for the job owning the
+// trigger, when the trigger fired.
+typedef struct
+{
+    const char *name;
+    int64_t period_ms;
+    void (*run)(bool triggered);
+    int64_t next_ms;
+} sensor_job_t;
+
+static bool temp_events;
+
+// Center the STTS2004 alarm window on the current temperature, EVENT then fires once
+// it drifts by more than TEMP_WINDOW_C
+static int temp_track(double temperature)
+{
+    return STTS2004_set_limits(temperature - TEMP_WINDOW_C, temperature + TEMP_WINDOW_C, TEMP_CRITICAL_C);
+}
+
+// Resolution and alarm window. Returns true when EVENT drives the reads.
+static bool temp_start(void)
+{
+    double temperature;
+
+    if (STTS2004_set_resolution(TEMP_RESOLUTION) != 0 || STTS2004_temperature(&temperature) != 0)
+    {
+        printk("Failed to configure STTS2004\n");
+        return false;
+    }
+    if (temp_track(temperature) != 0 || STTS2004_event_enable() != 0)
+    {
+        printk("STTS2004 EVENT unavailable, polling\n");
+        return false;
+    }
+    return true;
+}
+
+static void temp_run(bool triggered)
+{
+    struct sensor_temp_msg msg = {.uptime_ms = k_uptime_get()};
+
+    msg.status = STTS2004_read(&msg.temperature, &msg.alarms);
+    if (msg.status == 0 && temp_events && (triggered || msg.alarms))
+    {
+        temp_track(msg.temperature);
+    }
+    zbus_chan_pub(&sensor_temp_chan, &msg, K_NO_WAIT);
+}
+
+static void battery_run(bool triggered)
+{
+    struct sensor_battery_msg msg = {.uptime_ms = k_uptime_get()};
+
+    ARG_UNUSED(triggered);
+
+    if (battery_update() != 0)
+    {
+        // No ADC result yet
+        return;
+    }
+    battery_get(&msg.state);
+    zbus_chan_pub(&sensor_battery_chan, &msg, K_NO_WAIT);
+}
+
+static sensor_job_t sensor_jobs[] = {
+    {"temperature", TEMP_PERIOD_POLL_MS, temp_run, 0},
+    {"battery", BATTERY_UPDATE_PERIOD_MS, battery_run, 0},
+};
+
+// The temperature job owns the only trigger, STTS2004 EVENT
+#define SENSOR_JOB_TRIGGERED 0
+
+static void sensor_task(void *arg1, void *arg2, void *arg3)
+{
+    ARG_UNUSED(arg1);
+    ARG_UNUSED(arg2);
+    ARG_UNUSED(arg3);
+
+    temp_events = temp_start();
+    if (temp_events)
+    {
+        sensor_jobs[SENSOR_JOB_TRIGGERED].period_ms = TEMP_PERIOD_EVENT_MS;
+    }
+
+    while (1)
+    {
+        // Sleep until the earliest deadline, or the trigger
+        int64_t now = k_uptime_get();
+        int64_t next = INT64_MAX;
+        for (size_t i = 0; i < ARRAY_SIZE(sensor_jobs); i++)
+        {
+            next = MIN(next, sensor_jobs[i].next_ms);
+        }
+        bool triggered = STTS2004_wait_event(K_MSEC(MAX(next - now, 0))) == 0;
+
+        now = k_uptime_get();
+        for (size_t i = 0; i < ARRAY_SIZE(sensor_jobs); i++)
+        {
+            sensor_job_t *job = &sensor_jobs[i];
+            bool fired = triggered && i == SENSOR_JOB_TRIGGERED;
+            if (!fired && now < job->next_ms)
+            {
+                continue;
+            }
+            job->run(fired);
+            job->next_ms = now + job->period_ms;
+        }
+        if (triggered)
+        {
+            // A held EVENT would be seen again at once, pace the triggered reads
+            k_msleep(TEMP_MIN_INTERVAL_MS);
+        }
+    }
+}
+
+K_THREAD_DEFINE(sensor_thread_id, SENSORS_THREAD_STACK_SIZE, sensor_task, NULL, NULL, NULL,
+                SENSORS_THREAD_PRIORITY, 0, SYS_FOREVER_MS);
+
+// Start the sensor scheduler, once the board power and the ADC are up
+void sensor_init(void)
 {
-}
\ No newline at end of file
+    k_thread_start(sensor_thread_id);
+}
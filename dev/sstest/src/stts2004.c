@@ -1,28 +1,96 @@
+#include "stts2004.h"
+#include <math.h>
 #include <zephyr/drivers/i2c.h>
-#define STTS2004_I2C_TEMPERATURE_ADDRESS 0x18
-#define I2C0_NODE DT_NODELABEL(i2c0)
-const struct device *i2c0 = DEVICE_DT_GET(I2C0_NODE);
+#include <zephyr/drivers/gpio.h>
+#define STTS2004_NODE DT_NODELABEL(stts2004)
+
+// Registers, all 16 bits MSB first
+#define STTS2004_REG_CAPABILITY 0x00
+#define STTS2004_REG_CONFIG 0x01
+#define STTS2004_REG_UPPER 0x02
+#define STTS2004_REG_LOWER 0x03
+#define STTS2004_REG_CRITICAL 0x04
+#define STTS2004_REG_TEMPERATURE 0x05
+#define STTS2004_REG_RESOLUTION 0x08
+
+// Configuration register bits
+#define STTS2004_CONFIG_EVENT_MODE_INT BIT(0) // Clear: comparator, EVENT follows the alarms
+#define STTS2004_CONFIG_EVENT_POL_HIGH BIT(1)
+#define STTS2004_CONFIG_EVENT_CRIT_ONLY BIT(2)
+#define STTS2004_CONFIG_EVENT_OUTPUT_EN BIT(3)
+#define STTS2004_CONFIG_EVENT_STATUS BIT(4)
+#define STTS2004_CONFIG_WINDOW_LOCK BIT(6)
+#define STTS2004_CONFIG_CRIT_LOCK BIT(7)
+#define STTS2004_CONFIG_SHUTDOWN BIT(8)
+
+// Temperature register: alarm flags in bits 15..13, 13-bit two's complement in 1/16 C below
+#define STTS2004_TEMP_ALARM_SHIFT 13
+#define STTS2004_TEMP_MASK 0x1FFF
+// Limits use the same format with a 0.25 C resolution, bits 1..0 read 0
+#define STTS2004_LIMIT_MASK 0x1FFC
+#define STTS2004_LIMIT_MIN -40.0
+#define STTS2004_LIMIT_MAX 125.0
+
+// EVENT line, open drain and active low. Optional, without it the alarm flags are
+// only seen by the periodic reads.
+static const struct gpio_dt_spec stts2004_event =
+    GPIO_DT_SPEC_GET_OR(STTS2004_NODE, event_gpios, {0});
+static struct gpio_callback stts2004_event_cb;
+static K_SEM_DEFINE(stts2004_event_sem, 0, 1);
+
 typedef struct
 {
-    bool initialized;
+    struct i2c_dt_spec i2c;
+    bool initialized; // Bus ready, checked once
     bool data_valid;
     double temperature;
+    uint8_t alarms; // STTS2004_ALARM_* of the last read
 } stts2004_instance_t;
 
-stts2004_instance_t stts2004_instance;
+stts2004_instance_t stts2004_instance = {
+    .i2c = I2C_DT_SPEC_GET(STTS2004_NODE),
+};
 
 double STTS2004_calculate_temperature(uint16_t raw_temp)
 {
-    // Convert the raw temperature value to Celsius
-    // Adjust the conversion factor as per the sensor's datashee
-    int16_t tmp;
-    tmp = (raw_temp & 0x1000) ? -(raw_temp & 0x0FFF) : (raw_temp & 0x0FFF); // Sign extend for negative temperatures
+    // 13-bit two's complement, 0.0625 C per LSB
+    int16_t tmp = (int16_t)((raw_temp & STTS2004_TEMP_MASK) << 3) >> 3;
+
+    return ((double)tmp) * 0.0625;
+}
+
+static uint16_t STTS2004_limit_raw(double temp)
+{
+    temp = CLAMP(temp, STTS2004_LIMIT_MIN, STTS2004_LIMIT_MAX);
+    int16_t quarters = (int16_t)lround(temp * 4.0);
+
+    return ((uint16_t)quarters << 2) & STTS2004_LIMIT_MASK;
+}
+
+// Register pointer write and data read in one transaction with a repeated start
+static int stt2004_read_register(uint8_t reg, uint16_t *value)
+{
+    uint8_t reg_value[2];
 
-    return ((double)tmp) * 0.0625; // Example conversion factor, adjust as needed
+    int rc = i2c_write_read_dt(&stts2004_instance.i2c, &reg, 1, reg_value, sizeof(reg_value));
+    if (rc < 0)
+    {
+        return rc;
+    }
+    *value = (reg_value[0] << 8) | reg_value[1];
+    return 0;
+}
+
+static int stt2004_write_register(uint8_t reg, uint16_t value)
+{
+    uint8_t buf[3] = {reg, value >> 8, value & 0xFF};
+
+    return i2c_write_dt(&stts2004_instance.i2c, buf, sizeof(buf));
 }
+
 void stt2004_init()
 {
-    if (!device_is_ready(i2c0))
+    if (!i2c_is_ready_dt(&stts2004_instance.i2c))
     {
         stts2004_instance.initialized = false;
         stts2004_instance.data_valid = false;
@@ -31,48 +99,180 @@ void stt2004_init()
 
     stts2004_instance.initialized = true;
 }
-void stt2004_update()
+
+static void stt2004_store(uint16_t raw)
 {
-    uint8_t reg = 0x05; // Command to read temperature, adjust as needed
-    uint8_t reg_value[2] = {0};
-    struct i2c_msg msgs[] = {
-        {
-            .buf = &reg,
-            .len = 1,
-            .flags = I2C_MSG_WRITE | I2C_MSG_STOP,
-        },
-        {
-            .buf = reg_value,
-            .len = 2,
-            .flags = I2C_MSG_READ | I2C_MSG_STOP,
-        },
+    stts2004_instance.temperature = STTS2004_calculate_temperature(raw);
+    stts2004_instance.alarms = raw >> STTS2004_TEMP_ALARM_SHIFT;
+    stts2004_instance.data_valid = true;
+}
 
-    };
-    int rc = i2c_transfer(i2c0, msgs, 2, STTS2004_I2C_TEMPERATURE_ADDRESS);
+// A failed read only invalidates the data, the bus handle stays valid and the next
+// read simply retries (a NACK or arbitration loss is transient)
+static int stt2004_update()
+{
+    uint16_t raw;
 
+    int rc = stt2004_read_register(STTS2004_REG_TEMPERATURE, &raw);
     if (rc < 0)
     {
         stts2004_instance.data_valid = false;
-        stts2004_instance.initialized = false;
-        return;
+        return rc;
     }
-    double temperature = STTS2004_calculate_temperature((reg_value[0] << 8) | reg_value[1]); // Convert to Celsius, adjust scaling as needed
-    stts2004_instance.temperature = temperature;
-    stts2004_instance.data_valid = true;
+    stt2004_store(raw);
+    return 0;
 }
-int STTS2004_temperature(double *temp)
-{
 
+static int stt2004_check_init(void)
+{
     if (!stts2004_instance.initialized)
     {
         stt2004_init();
     }
+    return stts2004_instance.initialized ? 0 : -ENODEV;
+}
+
+// Temperature of the last conversion and the alarm flags it raised (STTS2004_ALARM_*)
+int STTS2004_read(double *temp, uint8_t *alarms)
+{
+    if (stt2004_check_init() < 0)
+    {
+        return -ENODEV;
+    }
 
-    stt2004_update();
-    if (!stts2004_instance.data_valid)
+    int rc = stt2004_update();
+    if (rc < 0)
     {
-        return -1; // Error: Data not valid
+        return rc;
     }
     *temp = stts2004_instance.temperature;
-    return 0; // Success
-};
\ No newline at end of file
+    if (alarms)
+    {
+        *alarms = stts2004_instance.alarms;
+    }
+    return 0;
+}
+
+int STTS2004_temperature(double *temp)
+{
+    return STTS2004_read(temp, NULL) == 0 ? 0 : -1;
+};
+
+// Conversion resolution, one of STTS2004_RESOLUTION_*. The sensor converts continuously,
+// a coarser resolution gives a shorter conversion and a lower average current.
+int STTS2004_set_resolution(uint8_t resolution)
+{
+    if (resolution > STTS2004_RESOLUTION_0_0625C)
+    {
+        return -EINVAL;
+    }
+    if (stt2004_check_init() < 0)
+    {
+        return -ENODEV;
+    }
+    return stt2004_write_register(STTS2004_REG_RESOLUTION, resolution);
+}
+
+int STTS2004_set_limits(double lower, double upper, double critical)
+{
+    if (lower >= upper || upper > critical)
+    {
+        return -EINVAL;
+    }
+    if (stt2004_check_init() < 0)
+    {
+        return -ENODEV;
+    }
+
+    int rc = stt2004_write_register(STTS2004_REG_UPPER, STTS2004_limit_raw(upper));
+    if (rc == 0)
+    {
+        rc = stt2004_write_register(STTS2004_REG_LOWER, STTS2004_limit_raw(lower));
+    }
+    if (rc == 0)
+    {
+        rc = stt2004_write_register(STTS2004_REG_CRITICAL, STTS2004_limit_raw(critical));
+    }
+    return rc;
+}
+
+static void stt2004_event_handler(const struct device *port, struct gpio_callback *cb, uint32_t pins)
+{
+    ARG_UNUSED(port);
+    ARG_UNUSED(cb);
+    ARG_UNUSED(pins);
+
+    k_sem_give(&stts2004_event_sem);
+}
+
+// EVENT in comparator mode: asserted while an alarm condition holds, released once the
+// temperature is back inside the limits. Set the limits first.
+int STTS2004_event_enable(void)
+{
+    static bool callback_added;
+
+    if (stts2004_event.port == NULL)
+    {
+        return -ENOTSUP;
+    }
+    if (!gpio_is_ready_dt(&stts2004_event))
+    {
+        return -ENODEV;
+    }
+    if (stt2004_check_init() < 0)
+    {
+        return -ENODEV;
+    }
+
+    int rc = stt2004_write_register(STTS2004_REG_CONFIG, STTS2004_CONFIG_EVENT_OUTPUT_EN);
+    if (rc < 0)
+    {
+        return rc;
+    }
+    rc = gpio_pin_configure_dt(&stts2004_event, GPIO_INPUT);
+    if (rc < 0)
+    {
+        return rc;
+    }
+    if (!callback_added)
+    {
+        gpio_init_callback(&stts2004_event_cb, stt2004_event_handler, BIT(stts2004_event.pin));
+        rc = gpio_add_callback(stts2004_event.port, &stts2004_event_cb);
+        if (rc < 0)
+        {
+            return rc;
+        }
+        callback_added = true;
+    }
+    k_sem_reset(&stts2004_event_sem);
+    return gpio_pin_interrupt_configure_dt(&stts2004_event, GPIO_INT_EDGE_TO_ACTIVE);
+}
+
+int STTS2004_event_disable(void)
+{
+    if (stts2004_event.port == NULL)
+    {
+        return -ENOTSUP;
+    }
+    if (stts2004_instance.initialized)
+    {
+        stt2004_write_register(STTS2004_REG_CONFIG, 0);
+    }
+    return gpio_pin_interrupt_configure_dt(&stts2004_event, GPIO_INT_DISABLE);
+}
+
+// Block until EVENT is asserted or the timeout expires (-EAGAIN). Returns at once while
+// EVENT is still active, the edge of an alarm that outlived new limits is not repeated.
+int STTS2004_wait_event(k_timeout_t timeout)
+{
+    if (stts2004_event.port == NULL)
+    {
+        k_sleep(timeout);
+        return -EAGAIN;
+    }
+    if (gpio_pin_get_dt(&stts2004_event) > 0)
+    {
+        return 0;
+    }
+    return k_sem_take(&stts2004_event_sem, timeout);
+}
@@ -0,0 +1,201 @@
+#include "telemetry.h"
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/crc.h>
+
+// Shared by all streams, frames are encoded from more than one thread
+static atomic_t telemetry_seq;
+
+// Worst case of one sample in a block: 32-bit time delta and 17-bit zig-zag fields
+#define TELEMETRY_BLOCK_SAMPLE_MAX (5 + TELEMETRY_BLOCK_FIELDS * 3)
+
+// Scale to fixed point, saturated to the int16 range. Single precision only, the FPU
+// has no double support and this runs for every IMU sample.
+static int16_t telemetry_fixed(float value, float scale)
+{
+    float scaled = CLAMP(value * scale, (float)INT16_MIN, (float)INT16_MAX);
+
+    return (int16_t)lroundf(scaled);
+}
+
+static uint8_t *telemetry_put(uint8_t *p, float value, float scale)
+{
+    sys_put_le16((uint16_t)telemetry_fixed(value, scale), p);
+    return p + 2;
+}
+
+static uint8_t *telemetry_put_varint(uint8_t *p, uint32_t value)
+{
+    while (value >= 0x80)
+    {
+        *p++ = (value & 0x7F) | 0x80;
+        value >>= 7;
+    }
+    *p++ = value;
+    return p;
+}
+
+// Small differences of either sign become small unsigned values: 0, -1, 1, -2, ...
+static uint32_t telemetry_zigzag(int32_t value)
+{
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static void telemetry_header(uint8_t *buf, uint16_t seq, uint64_t timestamp_ns, uint8_t sensors,
+                             size_t payload_len)
+{
+    buf[0] = TELEMETRY_MAGIC;
+    buf[1] = TELEMETRY_VERSION;
+    sys_put_le16(seq, &buf[2]);
+    sys_put_le32((uint32_t)(timestamp_ns / NSEC_PER_USEC), &buf[4]);
+    buf[8] = sensors;
+    buf[9] = payload_len;
+}
+
+// CRC over header and payload, returns the frame length
+static int telemetry_seal(uint8_t *buf, size_t len)
+{
+    sys_put_le16(crc16_itu_t(0xFFFF, buf, len), &buf[len]);
+    return len + TELEMETRY_CRC_SIZE;
+}
+
+int telemetry_encode(const telemetry_sample_t *sample, uint8_t *buf, size_t size)
+{
+    if (size < TELEMETRY_FRAME_MAX)
+    {
+        return -ENOMEM;
+    }
+
+    uint8_t *p = &buf[TELEMETRY_HEADER_SIZE];
+    if (sample->sensors & TELEMETRY_SENSOR_ACC)
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            p = telemetry_put(p, sample->imu.acc[i], 1000.0f);
+        }
+    }
+    if (sample->sensors & TELEMETRY_SENSOR_GYRO)
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            p = telemetry_put(p, sample->imu.gyro[i], 10.0f);
+        }
+    }
+    if (sample->sensors & TELEMETRY_SENSOR_IMU_TEMP)
+    {
+        p = telemetry_put(p, sample->imu.temp, 100.0f);
+    }
+    if (sample->sensors & TELEMETRY_SENSOR_TEMP)
+    {
+        p = telemetry_put(p, sample->temperature, 100.0f);
+    }
+    if (sample->sensors & TELEMETRY_SENSOR_VOLTAGE)
+    {
+        sys_put_le16((uint16_t)CLAMP(lroundf(sample->voltage * 1000.0f), 0, UINT16_MAX), p);
+        p += 2;
+    }
+
+    size_t payload_len = p - &buf[TELEMETRY_HEADER_SIZE];
+    telemetry_header(buf, atomic_inc(&telemetry_seq), sample->timestamp_ns,
+                     sample->sensors & (TELEMETRY_SENSOR_ACC | TELEMETRY_SENSOR_GYRO | TELEMETRY_SENSOR_IMU_TEMP |
+                                        TELEMETRY_SENSOR_TEMP | TELEMETRY_SENSOR_VOLTAGE),
+                     payload_len);
+    return telemetry_seal(buf, TELEMETRY_HEADER_SIZE + payload_len);
+}
+
+// The next block is a keyframe, call when the receiver may have lost the chain
+void telemetry_stream_reset(telemetry_stream_t *stream)
+{
+    stream->synced = false;
+}
+
+void telemetry_block_begin(telemetry_stream_t *stream, uint8_t *buf, size_t size)
+{
+    stream->buf = buf;
+    stream->size = MIN(size, TELEMETRY_BLOCK_MAX);
+    stream->count = 0;
+    stream->keyframe = !stream->synced || stream->blocks + 1 >= TELEMETRY_KEYFRAME_INTERVAL;
+    // Sample count, then the base block
+    stream->len = TELEMETRY_HEADER_SIZE + 1;
+    if (!stream->keyframe)
+    {
+        stream->len += 2;
+    }
+}
+
+int telemetry_block_add(telemetry_stream_t *stream, const iim42652_data_t *imu, uint64_t timestamp_ns)
+{
+    uint8_t sample[TELEMETRY_BLOCK_SAMPLE_MAX];
+    int16_t fields[TELEMETRY_BLOCK_FIELDS];
+    uint8_t *p = sample;
+
+    for (int i = 0; i < 3; i++)
+    {
+        fields[i] = telemetry_fixed(imu->acc[i], 1000.0f);
+        fields[3 + i] = telemetry_fixed(imu->gyro[i], 10.0f);
+    }
+    fields[6] = telemetry_fixed(imu->temp, 100.0f);
+
+    if (stream->count > 0)
+    {
+        uint64_t dt_us = (timestamp_ns - stream->last_ns) / NSEC_PER_USEC;
+        p = telemetry_put_varint(p, (uint32_t)MIN(dt_us, UINT32_MAX));
+    }
+    // The first sample of a keyframe is coded against zero, i.e. absolute
+    bool absolute = stream->keyframe && stream->count == 0;
+    for (int i = 0; i < TELEMETRY_BLOCK_FIELDS; i++)
+    {
+        int32_t base = absolute ? 0 : stream->last[i];
+        p = telemetry_put_varint(p, telemetry_zigzag((int32_t)fields[i] - base));
+    }
+
+    size_t n = p - sample;
+    if (stream->len + n + TELEMETRY_CRC_SIZE > stream->size || stream->count == UINT8_MAX)
+    {
+        // Even an empty block is too small for one sample
+        return stream->count == 0 ? -ENOMEM : -ENOSPC;
+    }
+    memcpy(&stream->buf[stream->len], sample, n);
+    stream->len += n;
+    if (stream->count == 0)
+    {
+        stream->first_ns = timestamp_ns;
+    }
+    stream->count++;
+    stream->last_ns = timestamp_ns;
+    memcpy(stream->last, fields, sizeof(fields));
+    return 0;
+}
+
+int telemetry_block_end(telemetry_stream_t *stream)
+{
+    uint8_t *buf = stream->buf;
+
+    if (stream->count == 0)
+    {
+        return 0;
+    }
+
+    uint16_t seq = atomic_inc(&telemetry_seq);
+    uint8_t sensors = TELEMETRY_SENSOR_ACC | TELEMETRY_SENSOR_GYRO | TELEMETRY_SENSOR_IMU_TEMP |
+                      TELEMETRY_FLAG_DELTA;
+    buf[TELEMETRY_HEADER_SIZE] = stream->count;
+    if (stream->keyframe)
+    {
+        sensors |= TELEMETRY_FLAG_KEYFRAME;
+        stream->blocks = 0;
+    }
+    else
+    {
+        sys_put_le16(stream->last_seq, &buf[TELEMETRY_HEADER_SIZE + 1]);
+        stream->blocks++;
+    }
+    telemetry_header(buf, seq, stream->first_ns, sensors, stream->len - TELEMETRY_HEADER_SIZE);
+    stream->last_seq = seq;
+    stream->synced = true;
+    stream->count = 0;
+    return telemetry_seal(buf, stream->len);
+}
@@ -0,0 +1,116 @@
+// INT1 driven acquisition of the driver API, the way the IMU thread of src/main.c runs it:
+// the emulator raises the event on an emulated GPIO, IIM42652_wait_event wakes up and the
+// FIFO is drained asynchronously. The sensor device leaves INT1 and the FIFO disarmed when
+// its stream ends, the fixtures restore the rest so either suite runs on its own.
+#include "iim42652_sensor.h"
+#include <zephyr/device.h>
+#include <zephyr/drivers/emul.h>
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/ztest.h>
+
+#define IMU_NODE DT_INST(0, invensense_iim42652)
+#define INT1_WATERMARK 4
+#define INT1_IDLE_TIMEOUT K_MSEC(20)
+#define INT1_EVENT_TIMEOUT K_MSEC(100)
+
+static const struct emul *const imu_emul = EMUL_DT_GET(IMU_NODE);
+static const struct gpio_dt_spec imu_int1 = GPIO_DT_SPEC_GET(IMU_NODE, int_gpios);
+
+static uint8_t fifo_raw[IIM42652_FIFO_MAX_PACKETS * IIM42652_FIFO_PACKET_SIZE];
+static iim42652_fifo_sample_t samples[IIM42652_FIFO_MAX_PACKETS];
+static struct k_poll_signal fifo_signal = K_POLL_SIGNAL_INITIALIZER(fifo_signal);
+
+static void iim42652_int1_before(void *fixture)
+{
+    ARG_UNUSED(fixture);
+
+    // INT1 goes to IIM42652_wait_event, from a clean FIFO and interrupt routing
+    IIM42652_set_event_handler(NULL);
+    IIM42652_int_disable();
+    IIM42652_fifo_disable();
+    zassert_ok(IIM42652_configure(IIM42652_ODR_1KHZ, IIM42652_RANGE_PM16G, IIM42652_RANGE_PM2kdps,
+                                  IIM42652_UI_FILT_BW_ODR_DIV4));
+}
+
+static void iim42652_int1_after(void *fixture)
+{
+    ARG_UNUSED(fixture);
+
+    IIM42652_int_disable();
+    IIM42652_fifo_disable();
+}
+
+ZTEST(iim42652_int1, test_data_ready)
+{
+    const iim42652_raw_t reading = {
+        .temp = 100,
+        .acc = {-2048, 512, 2048},
+        .gyro = {16, -32, 64},
+    };
+    iim42652_raw_t raw;
+    uint8_t status;
+
+    zassert_ok(IIM42652_int_enable(IIM42652_INT_DATA_READY));
+    zassert_equal(IIM42652_wait_event(INT1_IDLE_TIMEOUT, &status), -EAGAIN);
+
+    iim42652_emul_set_reading(imu_emul, &reading);
+    zassert_equal(gpio_pin_get_dt(&imu_int1), 1);
+    zassert_ok(IIM42652_wait_event(INT1_EVENT_TIMEOUT, &status));
+    zassert_true(status & IIM42652_INT_DATA_READY);
+    // Reading INT_STATUS acknowledged the event and released the line
+    zassert_equal(gpio_pin_get_dt(&imu_int1), 0);
+
+    zassert_ok(IIM42652_data_raw(&raw));
+    zassert_mem_equal(&raw, &reading, sizeof(raw));
+}
+
+ZTEST(iim42652_int1, test_fifo_watermark)
+{
+    iim42652_raw_t raw = {
+        .acc = {0, 0, 2048},
+    };
+    struct k_poll_event event =
+        K_POLL_EVENT_INITIALIZER(K_POLL_TYPE_SIGNAL, K_POLL_MODE_NOTIFY_ONLY, &fifo_signal);
+    unsigned int signaled;
+    int result;
+    uint8_t status;
+
+    zassert_ok(IIM42652_fifo_enable(INT1_WATERMARK));
+    zassert_ok(IIM42652_int_enable(IIM42652_INT_FIFO_THS));
+
+    // Below the watermark INT1 stays low and the thread keeps sleeping
+    for (int i = 0; i < INT1_WATERMARK - 1; i++)
+    {
+        raw.gyro[0] = 100 * i;
+        zassert_ok(iim42652_emul_push_fifo(imu_emul, &raw, 1000 * (i + 1)));
+    }
+    zassert_equal(IIM42652_wait_event(INT1_IDLE_TIMEOUT, &status), -EAGAIN);
+
+    raw.gyro[0] = 100 * (INT1_WATERMARK - 1);
+    zassert_ok(iim42652_emul_push_fifo(imu_emul, &raw, 1000 * INT1_WATERMARK));
+    zassert_ok(IIM42652_wait_event(INT1_EVENT_TIMEOUT, &status));
+    zassert_true(status & IIM42652_INT_FIFO_THS);
+
+    int n = IIM42652_fifo_read_async(fifo_raw, IIM42652_FIFO_MAX_PACKETS, &fifo_signal);
+    zassert_equal(n, INT1_WATERMARK);
+    zassert_ok(k_poll(&event, 1, INT1_EVENT_TIMEOUT));
+    k_poll_signal_check(&fifo_signal, &signaled, &result);
+    zassert_true(signaled);
+    zassert_ok(result);
+
+    zassert_equal(IIM42652_fifo_parse(fifo_raw, n, samples), n);
+    for (int i = 0; i < n; i++)
+    {
+        zassert_equal(samples[i].raw.acc[2], 2048, "sample %d", i);
+        zassert_equal(samples[i].raw.gyro[0], 100 * i, "sample %d", i);
+        if (i > 0)
+        {
+            zassert_true(samples[i].timestamp > samples[i - 1].timestamp, "sample %d", i);
+        }
+    }
+
+    // Drained, the next wait times out again
+    zassert_equal(IIM42652_wait_event(INT1_IDLE_TIMEOUT, &status), -EAGAIN);
+}
+
+ZTEST_SUITE(iim42652_int1, NULL, NULL, iim42652_int1_before, iim42652_int1_after, NULL);
@@ -0,0 +1,186 @@
+// IIM42652 driver and sensor device on native_sim, against the SPI emulator of src/iim42652_emul.c.
+// The devicetree node has no iim42652 label, everything binds through the instance.
+#include "iim42652_sensor.h"
+#include <zephyr/device.h>
+#include <zephyr/drivers/emul.h>
+#include <zephyr/drivers/sensor.h>
+#include <zephyr/rtio/rtio.h>
+#include <zephyr/ztest.h>
+
+#define IMU_NODE DT_INST(0, invensense_iim42652)
+
+// +-16 g and +-2000 dps over the signed 16-bit range
+#define ACC_MS2_PER_LSB (16.0f * 9.80665f / 32768.0f)
+#define GYRO_RADS_PER_LSB (2000.0f * 3.14159265f / 180.0f / 32768.0f)
+#define FIFO_PERIOD_US 1000 // 1 kHz
+#define DRAIN_SETTLE K_MSEC(10)
+
+static const struct device *const imu = DEVICE_DT_GET(IMU_NODE);
+static const struct emul *const imu_emul = EMUL_DT_GET(IMU_NODE);
+
+SENSOR_DT_READ_IODEV(imu_read_iodev, IMU_NODE, {SENSOR_CHAN_ACCEL_XYZ, 0}, {SENSOR_CHAN_GYRO_XYZ, 0},
+                     {SENSOR_CHAN_DIE_TEMP, 0});
+SENSOR_DT_STREAM_IODEV(imu_stream_iodev, IMU_NODE, {SENSOR_TRIG_FIFO_WATERMARK, SENSOR_STREAM_DATA_INCLUDE});
+
+RTIO_DEFINE(imu_read_ctx, 1, 1);
+RTIO_DEFINE_WITH_MEMPOOL(imu_stream_ctx, 4, 4, 16, 64, sizeof(uint64_t));
+
+// Active stream of the running test, cancelled by the suite teardown if the test did not
+static struct rtio_sqe *stream_handle;
+
+static float q31_to_float(q31_t value, int8_t shift)
+{
+    return (float)value / (float)(INT64_C(1) << (31 - shift));
+}
+
+// Queue one watermark worth of packets, INT1 rises with the last one
+static void push_watermark(iim42652_raw_t *raw, int32_t acc_step)
+{
+    for (int i = 0; i < CONFIG_IIM42652_STREAM_WATERMARK; i++)
+    {
+        raw->acc[0] = acc_step * i;
+        zassert_ok(iim42652_emul_push_fifo(imu_emul, raw, FIFO_PERIOD_US * (i + 1)));
+    }
+}
+
+// Cancel the stream and let the next event disarm it, INT1 and the FIFO go back to the driver
+static void stream_stop(void)
+{
+    iim42652_raw_t raw = {0};
+    struct rtio_cqe *cqe;
+
+    zassert_ok(rtio_sqe_cancel(stream_handle));
+    stream_handle = NULL;
+    push_watermark(&raw, 0);
+    k_sleep(DRAIN_SETTLE);
+    while ((cqe = rtio_cqe_consume(&imu_stream_ctx)) != NULL)
+    {
+        uint8_t *buf;
+        uint32_t buf_len;
+
+        if (rtio_cqe_get_mempool_buffer(&imu_stream_ctx, cqe, &buf, &buf_len) == 0)
+        {
+            rtio_release_buffer(&imu_stream_ctx, buf, buf_len);
+        }
+        rtio_cqe_release(&imu_stream_ctx, cqe);
+    }
+}
+
+static void iim42652_sensor_before(void *fixture)
+{
+    ARG_UNUSED(fixture);
+
+    zassert_true(device_is_ready(imu));
+    // The driver API suite may have left the FIFO or INT1 running
+    IIM42652_int_disable();
+    IIM42652_fifo_disable();
+    IIM42652_set_event_handler(NULL);
+    zassert_ok(IIM42652_configure(IIM42652_ODR_1KHZ, IIM42652_RANGE_PM16G, IIM42652_RANGE_PM2kdps,
+                                  IIM42652_UI_FILT_BW_ODR_DIV4));
+}
+
+static void iim42652_sensor_after(void *fixture)
+{
+    ARG_UNUSED(fixture);
+
+    if (stream_handle)
+    {
+        stream_stop();
+    }
+}
+
+ZTEST(iim42652_sensor, test_read_decode)
+{
+    const iim42652_raw_t raw = {
+        .temp = 1325, // 35 C
+        .acc = {2048, -4096, 1024},
+        .gyro = {164, -1640, 0},
+    };
+    const struct sensor_decoder_api *decoder;
+    struct sensor_three_axis_data acc;
+    struct sensor_three_axis_data gyro;
+    struct sensor_q31_data temp;
+    uint8_t buf[64] __aligned(8);
+    uint16_t frames;
+    uint32_t fit;
+
+    iim42652_emul_set_reading(imu_emul, &raw);
+    zassert_ok(sensor_read(&imu_read_iodev, &imu_read_ctx, buf, sizeof(buf)));
+    zassert_ok(sensor_get_decoder(imu, &decoder));
+
+    zassert_ok(decoder->get_frame_count(buf, (struct sensor_chan_spec){SENSOR_CHAN_ACCEL_XYZ, 0}, &frames));
+    zassert_equal(frames, 1);
+
+    fit = 0;
+    zassert_equal(decoder->decode(buf, (struct sensor_chan_spec){SENSOR_CHAN_ACCEL_XYZ, 0}, &fit, 1, &acc), 1);
+    fit = 0;
+    zassert_equal(decoder->decode(buf, (struct sensor_chan_spec){SENSOR_CHAN_GYRO_XYZ, 0}, &fit, 1, &gyro), 1);
+    for (int axis = 0; axis < 3; axis++)
+    {
+        zassert_within(q31_to_float(acc.readings[0].values[axis], acc.shift), raw.acc[axis] * ACC_MS2_PER_LSB,
+                       0.01f, "accel axis %d", axis);
+        zassert_within(q31_to_float(gyro.readings[0].values[axis], gyro.shift), raw.gyro[axis] * GYRO_RADS_PER_LSB,
+                       0.001f, "gyro axis %d", axis);
+    }
+
+    fit = 0;
+    zassert_equal(decoder->decode(buf, (struct sensor_chan_spec){SENSOR_CHAN_DIE_TEMP, 0}, &fit, 1, &temp), 1);
+    zassert_within(q31_to_float(temp.readings[0].temperature, temp.shift), 35.0f, 0.01f);
+}
+
+ZTEST(iim42652_sensor, test_stream_fifo_watermark)
+{
+    iim42652_raw_t raw = {
+        .gyro = {0, 0, 1640},
+    };
+    const struct sensor_decoder_api *decoder;
+    struct rtio_cqe *cqe;
+    uint8_t *buf;
+    uint32_t buf_len;
+    uint16_t frames;
+
+    zassert_ok(sensor_get_decoder(imu, &decoder));
+    zassert_ok(sensor_stream(&imu_stream_iodev, &imu_stream_ctx, NULL, &stream_handle));
+
+    // The emulator raises FIFO_THS on INT1 with the last packet, the drain lands in the pool
+    push_watermark(&raw, 1024);
+
+    cqe = rtio_cqe_consume_block(&imu_stream_ctx);
+    zassert_ok(cqe->result);
+    zassert_ok(rtio_cqe_get_mempool_buffer(&imu_stream_ctx, cqe, &buf, &buf_len));
+    rtio_cqe_release(&imu_stream_ctx, cqe);
+
+    zassert_true(decoder->has_trigger(buf, SENSOR_TRIG_FIFO_WATERMARK));
+    zassert_ok(decoder->get_frame_count(buf, (struct sensor_chan_spec){SENSOR_CHAN_ACCEL_XYZ, 0}, &frames));
+    zassert_equal(frames, CONFIG_IIM42652_STREAM_WATERMARK);
+
+    uint32_t fit = 0;
+    uint64_t prev_ns = 0;
+    for (int i = 0; i < frames; i++)
+    {
+        struct sensor_three_axis_data acc;
+        struct sensor_three_axis_data gyro;
+        uint32_t gyro_fit = fit;
+
+        zassert_equal(decoder->decode(buf, (struct sensor_chan_spec){SENSOR_CHAN_ACCEL_XYZ, 0}, &fit, 1, &acc), 1);
+        zassert_equal(
+            decoder->decode(buf, (struct sensor_chan_spec){SENSOR_CHAN_GYRO_XYZ, 0}, &gyro_fit, 1, &gyro), 1);
+        zassert_within(q31_to_float(acc.readings[0].values[0], acc.shift), 1024 * i * ACC_MS2_PER_LSB, 0.01f,
+                       "frame %d", i);
+        zassert_within(q31_to_float(gyro.readings[0].values[2], gyro.shift), 1640 * GYRO_RADS_PER_LSB, 0.001f,
+                       "frame %d", i);
+        if (i > 0)
+        {
+            // Frames are spaced by their FIFO timestamps
+            zassert_equal(acc.header.base_timestamp_ns - prev_ns, FIFO_PERIOD_US * NSEC_PER_USEC, "frame %d", i);
+        }
+        prev_ns = acc.header.base_timestamp_ns;
+    }
+    rtio_release_buffer(&imu_stream_ctx, buf, buf_len);
+
+    // The next event finds the request cancelled and disarms the FIFO interrupt
+    stream_stop();
+    zassert_equal(iim42652_emul_get_reg(imu_emul, 0, IIM42652_INT_SOURCE0), 0);
+}
+
+ZTEST_SUITE(iim42652_sensor, NULL, NULL, iim42652_sensor_before, iim42652_sensor_after, NULL);
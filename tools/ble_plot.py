@@ -1,11 +1,16 @@
 import asyncio
 import sys
 import json
+import os
+import socket
+import struct
+import ctypes
 from bleak import BleakClient, BleakScanner
 import matplotlib.pyplot as plt
 from matplotlib.animation import FuncAnimation
 from collections import deque
 import threading
+import telemetry
 
 NUS_RX_CHAR_UUID = "6e400002-b5a3-f393-e0a9-e50e24dcca9e"  # Write
 NUS_TX_CHAR_UUID = "6e400003-b5a3-f393-e0a9-e50e24dcca9e"  # Notify
@@ -16,10 +21,13 @@ imu_temp_data = deque(maxlen=HIST_LEN)
 voltage_data = deque(maxlen=HIST_LEN)
 acc_data = [deque(maxlen=HIST_LEN) for _ in range(3)]
 gyro_data = [deque(maxlen=HIST_LEN) for _ in range(3)]
+# Sample time in seconds from the device "ts" field (us of uptime), IMU traces are
+# plotted against it so BLE delivery jitter does not distort the signal
+ts_data = deque(maxlen=HIST_LEN)
 data_lock = threading.Lock()
 
 def init_plots():
-    fig, axs = plt.subplots(4, 1, figsize=(10, 10), sharex=True)
+    fig, axs = plt.subplots(4, 1, figsize=(10, 10))
     # Temperature and IMU temp
     l_temp, = axs[0].plot([], [], label="temperature")
     l_imu_temp, = axs[0].plot([], [], label="imu_temp")
@@ -41,7 +49,7 @@ def init_plots():
     axs[3].legend()
     axs[3].set_ylabel("Gyro (dps)")
     axs[3].set_title("Gyroscope")
-    axs[3].set_xlabel("Samples")
+    axs[3].set_xlabel("Samples / time (s)")
     plt.tight_layout()
     return fig, axs, l_temp, l_imu_temp, l_voltage, l_acc, l_gyro
 
@@ -51,15 +59,97 @@ def update_plots(frame, l_temp, l_imu_temp, l_voltage, l_acc, l_gyro):
         l_temp.set_data(x, list(temp_data))
         l_imu_temp.set_data(x, list(imu_temp_data))
         l_voltage.set_data(x, list(voltage_data))
+        imu_x = list(ts_data) if len(ts_data) == len(acc_data[0]) else range(len(acc_data[0]))
         for i in range(3):
-            l_acc[i].set_data(x, list(acc_data[i]))
-            l_gyro[i].set_data(x, list(gyro_data[i]))
+            l_acc[i].set_data(imu_x, list(acc_data[i]))
+            l_gyro[i].set_data(imu_x, list(gyro_data[i]))
         for ax in l_temp.axes.figure.axes:
             ax.relim()
             ax.autoscale_view()
     return [l_temp, l_imu_temp, l_voltage] + l_acc + l_gyro
 
-async def ble_task(target_name):
+# Shared by the NUS and L2CAP paths, the delta chain spans both
+decoder = telemetry.Decoder()
+
+def handle_data(data):
+    """Notification or L2CAP SDU: JSON, or binary telemetry frames."""
+    try:
+        if data[0] == telemetry.FRAME_MAGIC:
+            with data_lock:
+                records = decoder.decode(data)
+        else:
+            records = [json.loads(data.decode(errors='replace'))]
+            if "batch" in records[0]:
+                print(f"Batching: {records[0]['batch']}")
+            if "link" in records[0]:
+                print(f"Link: {records[0]['link']}")
+        with data_lock:
+            for js in records:
+                if "temperature" in js:
+                    temp_data.append(js.get("temperature", 0))
+                if "imu_temp" in js:
+                    imu_temp_data.append(js.get("imu_temp", 0))
+                if "voltage" in js:
+                    voltage_data.append(js.get("voltage", 0))
+                if "acc" in js:
+                    if "ts" in js:
+                        ts_data.append(js["ts"] / 1e6)
+                    for i in range(3):
+                        acc_data[i].append(js["acc"][i])
+                if "gyro" in js:
+                    for i in range(3):
+                        gyro_data[i].append(js["gyro"][i])
+    except Exception as e:
+        print(f"Parse error: {e}")
+
+# LE credit based L2CAP channel of dev/sstest/inc/ble_l2cap.h. bleak has no L2CAP
+# support, the channel is opened with a BlueZ socket over the connection bleak made.
+L2CAP_PSM = 0x0081
+L2CAP_RX_MTU = 1024
+BDADDR_LE_PUBLIC = 1
+BDADDR_LE_RANDOM = 2
+SOL_BLUETOOTH = 274
+BT_RCVMTU = 13
+
+class SockaddrL2(ctypes.Structure):
+    _fields_ = [("l2_family", ctypes.c_ushort),
+                ("l2_psm", ctypes.c_ushort),
+                ("l2_bdaddr", ctypes.c_uint8 * 6),
+                ("l2_cid", ctypes.c_ushort),
+                ("l2_bdaddr_type", ctypes.c_uint8)]
+
+def l2cap_connect(address, addr_type):
+    """Python's L2CAP address has no LE address type, connect through libc instead."""
+    sock = socket.socket(socket.AF_BLUETOOTH, socket.SOCK_SEQPACKET, socket.BTPROTO_L2CAP)
+    sock.setsockopt(SOL_BLUETOOTH, BT_RCVMTU, struct.pack("<H", L2CAP_RX_MTU))
+    addr = SockaddrL2()
+    addr.l2_family = socket.AF_BLUETOOTH
+    addr.l2_psm = L2CAP_PSM
+    addr.l2_bdaddr[:] = bytes(int(b, 16) for b in reversed(address.split(":")))
+    addr.l2_bdaddr_type = addr_type
+    libc = ctypes.CDLL(None, use_errno=True)
+    if libc.connect(sock.fileno(), ctypes.byref(addr), ctypes.sizeof(addr)) != 0:
+        err = ctypes.get_errno()
+        sock.close()
+        raise OSError(err, os.strerror(err))
+    return sock
+
+def l2cap_reader(address, addr_type):
+    try:
+        sock = l2cap_connect(address, addr_type)
+    except OSError as e:
+        print(f"L2CAP connect failed: {e}, staying on NUS")
+        return
+    print(f"L2CAP channel open on PSM {L2CAP_PSM:#06x}")
+    with sock:
+        while True:
+            sdu = sock.recv(L2CAP_RX_MTU)
+            if not sdu:
+                break
+            handle_data(sdu)
+    print("L2CAP channel closed")
+
+async def ble_task(target_name, command, l2cap_type):
     print("Scanning for BLE devices...")
     devices = await BleakScanner.discover(timeout=5.0)
     target = None
@@ -74,39 +164,40 @@ async def ble_task(target_name):
         print(f"Connected to {target.address}")
 
         def handle_notify(sender, data):
-            try:
-                msg = data.decode(errors='replace')
-                js = json.loads(msg)
-                with data_lock:
-                    if "temperature" in js:
-                        temp_data.append(js.get("temperature", 0))
-                    if "imu_temp" in js:
-                        imu_temp_data.append(js.get("imu_temp", 0))
-                    if "voltage" in js:
-                        voltage_data.append(js.get("voltage", 0))
-                    if "acc" in js:
-                        for i in range(3):
-                            acc_data[i].append(js["acc"][i])
-                    if "gyro" in js:
-                        for i in range(3):
-                            gyro_data[i].append(js["gyro"][i])
-            except Exception as e:
-                print(f"JSON parse error: {e}")
+            handle_data(data)
 
         await client.start_notify(NUS_TX_CHAR_UUID, handle_notify)
+        if command:
+            await client.write_gatt_char(NUS_RX_CHAR_UUID, command)
+        if l2cap_type:
+            threading.Thread(target=l2cap_reader, args=(target.address, l2cap_type), daemon=True).start()
         while True:
             await asyncio.sleep(0.1)  # Keep BLE running
 
-def run_ble_loop(target_name):
-    asyncio.run(ble_task(target_name))
+def run_ble_loop(target_name, command, l2cap_type):
+    asyncio.run(ble_task(target_name, command, l2cap_type))
+
+def stream_command(options):
+    """Stream format to select on connect, None keeps the device default."""
+    if "--delta" in options:
+        return telemetry.COMMAND_STREAM_DELTA
+    if "--binary" in options:
+        return telemetry.COMMAND_STREAM_BINARY
+    return None
+
+def l2cap_address_type(options):
+    """LE address type for the L2CAP stream, None to stay on NUS."""
+    if "--l2cap" not in options:
+        return None
+    return BDADDR_LE_PUBLIC if "--public" in options else BDADDR_LE_RANDOM
 
 if __name__ == "__main__":
     if len(sys.argv) < 2:
-        print("Usage: python ble_plot.py <DEVICE_NAME_OR_ADDRESS>")
+        print("Usage: python ble_plot.py <DEVICE_NAME_OR_ADDRESS> [--binary | --delta] [--l2cap [--public]]")
         sys.exit(1)
 
     # Start BLE in a background thread
-    ble_thread = threading.Thread(target=run_ble_loop, args=(sys.argv[1],), daemon=True)
+    ble_thread = threading.Thread(target=run_ble_loop, args=(sys.argv[1], stream_command(sys.argv[2:]), l2cap_address_type(sys.argv[2:])), daemon=True)
     ble_thread.start()
 
     # Start plotting in main thread
@@ -0,0 +1,165 @@
+"""Decoder of the binary telemetry stream, see dev/sstest/inc/telemetry.h.
+
+Records use the keys of the JSON stream: ts (us of uptime), acc (g), gyro (dps),
+imu_temp, temperature (C) and voltage (V), plus the frame sequence number.
+"""
+import struct
+import binascii
+
+FRAME_MAGIC = 0xA5
+FRAME_VERSION = 1
+FRAME_HEADER = struct.Struct("<BBHIBB")
+FRAME_CRC = struct.Struct("<H")
+
+SENSOR_ACC = 0x01
+SENSOR_GYRO = 0x02
+SENSOR_IMU_TEMP = 0x04
+SENSOR_TEMP = 0x08
+SENSOR_VOLTAGE = 0x10
+FLAG_KEYFRAME = 0x40
+FLAG_DELTA = 0x80
+
+# Field order and fixed point scale of the IMU records and of the delta blocks
+IMU_FIELDS = 7
+ACC_SCALE = 1000.0
+GYRO_SCALE = 10.0
+TEMP_SCALE = 100.0
+VOLTAGE_SCALE = 1000.0
+
+COMMAND_STREAM_JSON = b"j"
+COMMAND_STREAM_BINARY = b"b"
+COMMAND_STREAM_DELTA = b"d"
+
+
+class FrameError(ValueError):
+    pass
+
+
+def _varint(data, offset, end):
+    value = 0
+    shift = 0
+    while True:
+        if offset >= end:
+            raise FrameError("truncated varint")
+        byte = data[offset]
+        offset += 1
+        value |= (byte & 0x7F) << shift
+        if not byte & 0x80:
+            return value, offset
+        shift += 7
+
+
+def _unzigzag(value):
+    return (value >> 1) ^ -(value & 1)
+
+
+def _imu_record(fields):
+    return {
+        "acc": [v / ACC_SCALE for v in fields[0:3]],
+        "gyro": [v / GYRO_SCALE for v in fields[3:6]],
+        "imu_temp": fields[6] / TEMP_SCALE,
+    }
+
+
+class Decoder:
+    """Stateful decoder, keeps the time base and the delta chain between frames."""
+
+    def __init__(self):
+        self.ts_last = None
+        self.ts_high = 0
+        # Sequence number and last sample of the previous delta block
+        self.block_seq = None
+        self.block_last = None
+        self.skipped_blocks = 0
+
+    def _unwrap(self, ts):
+        # The frame time is the low 32 bits of the uptime in us. Frames of different
+        # sensors interleave slightly out of order, only a large step back is a wrap.
+        if self.ts_last is not None and self.ts_last - ts > 1 << 31:
+            self.ts_high += 1 << 32
+        self.ts_last = ts
+        return self.ts_high + ts
+
+    def decode(self, data):
+        """Decode all frames of a notification, returns a list of records."""
+        records = []
+        offset = 0
+        while offset < len(data):
+            frame_records, offset = self.decode_frame(data, offset)
+            records.extend(frame_records)
+        return records
+
+    def decode_frame(self, data, start=0):
+        """Decode the frame at start, returns its records and the offset of the next frame."""
+        if len(data) < start + FRAME_HEADER.size + FRAME_CRC.size:
+            raise FrameError("short frame")
+        magic, version, seq, ts, sensors, length = FRAME_HEADER.unpack_from(data, start)
+        if magic != FRAME_MAGIC or version != FRAME_VERSION:
+            raise FrameError(f"unsupported frame {magic:#x} v{version}")
+        end = start + FRAME_HEADER.size + length
+        if len(data) < end + FRAME_CRC.size:
+            raise FrameError("truncated frame")
+        crc, = FRAME_CRC.unpack_from(data, end)
+        # CRC-16/CCITT-FALSE, crc_hqx with an 0xFFFF seed
+        if binascii.crc_hqx(bytes(data[start:end]), 0xFFFF) != crc:
+            raise FrameError(f"CRC mismatch in frame {seq}")
+
+        ts = self._unwrap(ts)
+        offset = start + FRAME_HEADER.size
+        if sensors & FLAG_DELTA:
+            records = self._decode_block(data, offset, end, seq, ts, sensors)
+        else:
+            records = [self._decode_sample(data, offset, seq, ts, sensors)]
+        return records, end + FRAME_CRC.size
+
+    def _decode_sample(self, data, offset, seq, ts, sensors):
+        js = {"seq": seq}
+
+        def take(fmt):
+            nonlocal offset
+            values = struct.unpack_from(fmt, data, offset)
+            offset += struct.calcsize(fmt)
+            return values
+        if sensors & SENSOR_ACC:
+            js["acc"] = [v / ACC_SCALE for v in take("<3h")]
+            js["ts"] = ts
+        if sensors & SENSOR_GYRO:
+            js["gyro"] = [v / GYRO_SCALE for v in take("<3h")]
+        if sensors & SENSOR_IMU_TEMP:
+            js["imu_temp"] = take("<h")[0] / TEMP_SCALE
+        if sensors & SENSOR_TEMP:
+            js["temperature"] = take("<h")[0] / TEMP_SCALE
+        if sensors & SENSOR_VOLTAGE:
+            js["voltage"] = take("<H")[0] / VOLTAGE_SCALE
+        return js
+
+    def _decode_block(self, data, offset, end, seq, ts, sensors):
+        count = data[offset]
+        offset += 1
+        if sensors & FLAG_KEYFRAME:
+            last = [0] * IMU_FIELDS
+        else:
+            base, = struct.unpack_from("<H", data, offset)
+            offset += 2
+            if base != self.block_seq:
+                # The block the deltas refer to was lost, wait for the next keyframe
+                self.block_seq = None
+                self.skipped_blocks += 1
+                return []
+            last = list(self.block_last)
+
+        records = []
+        for i in range(count):
+            if i > 0:
+                dt, offset = _varint(data, offset, end)
+                ts += dt
+            for f in range(IMU_FIELDS):
+                delta, offset = _varint(data, offset, end)
+                last[f] += _unzigzag(delta)
+            js = _imu_record(last)
+            js["seq"] = seq
+            js["ts"] = ts
+            records.append(js)
+        self.block_seq = seq
+        self.block_last = last
+        return records